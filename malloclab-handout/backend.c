@@ -0,0 +1,143 @@
+/*
+ * backend.c - The registry of allocator backends
+ *
+ * A shared object is opened with RTLD_LOCAL, so that its malloc does
+ * not replace the one the driver itself uses. A variant of mm.c built
+ * together with memlib.c (see the %.so rule in the Makefile) exports
+ * mm_init, mm_malloc, mm_free, mm_free_bytes, mm_heapinfo and the
+ * mm_phase_ and mm_counts_ functions and mm_get_stats, and its
+ * own copy of mem_reset and mem_heapsize, which are used for its reset
+ * and heapsize.
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dlfcn.h>
+#include <link.h>
+
+#include "backend.h"
+#include "mm.h"
+#include "memlib.h"
+
+backend_t mm_backend = {
+    "mm", mm_init, mm_malloc, mm_free, NULL, mem_reset, mem_heapsize, 
+    mm_free_bytes, mm_heapinfo, mm_phase_get, mm_phase_clear,
+    mm_counts_get, mm_counts_clear, mm_get_stats, 1
+};
+
+backend_t libc_backend = {
+    "libc", NULL, malloc, free, realloc, NULL, NULL, NULL, NULL, NULL, NULL,
+    NULL, NULL, NULL, 0
+};
+
+/* The built-in backends, by name */
+static backend_t *builtins[] = { &mm_backend, &libc_backend, NULL };
+
+/*
+ * look up prefix##name in a shared object. dlsym also searches the
+ * object's dependencies, so a plain "malloc" would be found in libc
+ * even if the object defines none; only a symbol that the object
+ * itself defines counts.
+ */
+static void *lookup(void *handle, const char *prefix, const char *name)
+{
+    char sym[256];
+    void *p;
+    Dl_info info;
+    struct link_map *lm;
+
+    snprintf(sym, sizeof(sym), "%s%s", prefix, name);
+    if ((p = dlsym(handle, sym)) == NULL)
+	return NULL;
+    if (dlinfo(handle, RTLD_DI_LINKMAP, &lm) != 0 ||
+	dladdr(p, &info) == 0 || info.dli_fname == NULL ||
+	strcmp(info.dli_fname, lm->l_name) != 0)
+	return NULL;
+    return p;
+}
+
+/* load the backend in the shared object path, with the given prefix */
+static backend_t *load(const char *path, const char *prefix,
+		       char *errmsg, size_t len)
+{
+    void *handle;
+    backend_t *b;
+    void (*mem_init_so)(void);
+    const char *base;
+
+    if ((handle = dlopen(path, RTLD_NOW | RTLD_LOCAL)) == NULL) {
+	snprintf(errmsg, len, "%s", dlerror());
+	return NULL;
+    }
+    if (prefix == NULL)
+	prefix = lookup(handle, "mm_", "malloc") ? "mm_" : "";
+
+    if ((b = calloc(1, sizeof(backend_t))) == NULL) {
+	snprintf(errmsg, len, "out of memory");
+	dlclose(handle);
+	return NULL;
+    }
+    b->init = lookup(handle, prefix, "init");
+    b->malloc = lookup(handle, prefix, "malloc");
+    b->free = lookup(handle, prefix, "free");
+    b->realloc = lookup(handle, prefix, "realloc");
+    b->reset = lookup(handle, prefix, "reset");
+    b->heapsize = lookup(handle, prefix, "heapsize");
+    b->freebytes = lookup(handle, prefix, "free_bytes");
+    b->heapinfo = lookup(handle, prefix, "heapinfo");
+    b->phase_get = lookup(handle, prefix, "phase_get");
+    b->phase_clear = lookup(handle, prefix, "phase_clear");
+    b->counts_get = lookup(handle, prefix, "counts_get");
+    b->counts_clear = lookup(handle, prefix, "counts_clear");
+    b->stats = lookup(handle, prefix, "get_stats");
+    if (b->malloc == NULL || b->free == NULL) {
+	snprintf(errmsg, len, "%s has no %smalloc and %sfree",
+		 path, prefix, prefix);
+	free(b);
+	dlclose(handle);
+	return NULL;
+    }
+
+    /* an mm.c variant brings its own copy of memlib */
+    if (b->reset == NULL)
+	b->reset = lookup(handle, "mem_", "reset");
+    if (b->heapsize == NULL)
+	b->heapsize = lookup(handle, "mem_", "heapsize");
+    if ((mem_init_so = lookup(handle, "mem_", "init")) != NULL)
+	mem_init_so();
+
+    /* name it after the file, which keeps it apart from the built-ins */
+    base = strrchr(path, '/') ? strrchr(path, '/') + 1 : path;
+    b->name = strdup(base);
+    return b;
+}
+
+/*
+ * backend_get - Find a built-in backend or load one from a shared object
+ */
+backend_t *backend_get(const char *spec, char *errmsg, size_t len)
+{
+    char *path, *colon;
+    backend_t *b;
+    int i;
+
+    for (i = 0; builtins[i] != NULL; i++)
+	if (strcmp(spec, builtins[i]->name) == 0)
+	    return builtins[i];
+
+    if (strstr(spec, ".so") == NULL) {
+	snprintf(errmsg, len, "unknown backend %s", spec);
+	return NULL;
+    }
+    if ((path = strdup(spec)) == NULL) {
+	snprintf(errmsg, len, "out of memory");
+	return NULL;
+    }
+    colon = strrchr(path, ':');
+    if (colon != NULL)
+	*colon = 0;
+    b = load(path, colon ? colon + 1 : NULL, errmsg, len);
+    free(path);
+    return b;
+}
@@ -0,0 +1,46 @@
+/*
+ * backend.h - Allocator backends that mdriver can evaluate. The mm
+ *     package and libc malloc are built in; others are loaded from
+ *     shared objects.
+ */
+#ifndef __BACKEND_H_
+#define __BACKEND_H_
+
+#include <stddef.h>
+#include "mm.h"
+
+/* The entry points of one allocator */
+typedef struct {
+    const char *name;
+    int (*init)(void);          /* start a fresh heap, <0 on failure, or NULL */
+    void *(*malloc)(size_t size);
+    void (*free)(void *ptr);
+    void *(*realloc)(void *ptr, size_t size); /* or NULL if there is none */
+    void (*reset)(void);        /* release the whole heap, or NULL */
+    size_t (*heapsize)(void);   /* bytes of heap in use, or NULL if unknown */
+    size_t (*freebytes)(void);  /* bytes on its free lists, or NULL */
+    void (*heapinfo)(mm_heapinfo_t *info); /* a snapshot of its free
+					      blocks and chunks, or NULL */
+    int (*phase_get)(mm_phases_t *p); /* cycles per phase of an mm.c
+					 built with MM_PROFILE, or NULL */
+    void (*phase_clear)(void);
+    void (*counts_get)(mm_counts_t *c); /* its search and split counts,
+					   or NULL */
+    void (*counts_clear)(void);
+    void (*stats)(struct mm_stats *s); /* its running totals, or NULL */
+    int memlib;                 /* set if its pages come from the driver's
+				   memlib, so they can be checked */
+} backend_t;
+
+extern backend_t mm_backend;
+extern backend_t libc_backend;
+
+/*
+ * Return the backend named by spec: either a built-in name ("mm",
+ * "libc") or a shared object as path.so[:prefix], whose functions are
+ * named prefix##malloc and so on. Without a prefix, "mm_" is tried
+ * before "". On failure, return NULL and describe why in errmsg.
+ */
+backend_t *backend_get(const char *spec, char *errmsg, size_t len);
+
+#endif /* __BACKEND_H_ */
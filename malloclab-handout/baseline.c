@@ -0,0 +1,303 @@
+/*
+ * baseline.c - Compare results against a saved --format=json run
+ *
+ * A metric is flagged when it moves by more than a threshold in the
+ * bad direction. Utilization is deterministic, so any such move is
+ * real. Throughput is noisy: when both runs were timed with
+ * --rigorous, its change must also pass a Welch t-test on the median
+ * time, the statistic that kops is computed from, at the 95% level.
+ * Without distributions on both sides it can't be tested, and a move
+ * is reported as untested rather than as a regression. The totals are
+ * tested the same way, on the sums of the per-trace medians.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+
+#include "baseline.h"
+#include "json.h"
+
+#define ERRLEN 256
+
+/* Outcomes of comparing one metric */
+#define SAME      0   /* within the threshold */
+#define NOISE     1   /* beyond the threshold, but not significant */
+#define IMPROVED  2
+#define REGRESSED 3
+#define UNTESTED  4   /* beyond the threshold, with nothing to test */
+
+static const char *verdict_names[] = { "", "noise", "improved", "REGRESSION",
+				       "untested" };
+
+/* ANSI colors used for each verdict when printing to a terminal */
+static const char *verdict_colors[] = { "", "", "\033[32m", "\033[1;31m",
+					"" };
+#define COLOR_OFF "\033[0m"
+
+/* Whether a change is significant: yes, no, or it can't be tested */
+#define SIG_NO       0
+#define SIG_YES      1
+#define SIG_UNTESTED (-1)
+
+/* The standard error of a median is about sqrt(pi/2) times that of
+   the mean, for samples that are roughly normal */
+#define MEDIAN_SE 1.2533
+
+static int use_color;
+
+/* A median time, or a sum of independent ones, and its sampling
+   variance, for the Welch test */
+typedef struct {
+    int ok;         /* cleared if some part had no distribution */
+    double median;  /* sum of the medians */
+    double var;     /* sum of their variances */
+    double df_den;  /* sum of var^2/(reps-1), for Welch-Satterthwaite */
+} dist_t;
+
+static void dist_init(dist_t *d)
+{
+    d->ok = 1;
+    d->median = d->var = d->df_den = 0;
+}
+
+/* add one distribution of reps samples to d */
+static void dist_add(dist_t *d, double median, double stddev, double reps)
+{
+    double v;
+
+    if (reps < 2) {
+	d->ok = 0;
+	return;
+    }
+    v = MEDIAN_SE*MEDIAN_SE * stddev*stddev / reps;
+    d->median += median;
+    d->var += v;
+    d->df_den += v*v / (reps - 1);
+}
+
+/* add a baseline "timing" object, which may be missing, to d */
+static void dist_add_json(dist_t *d, json_t *t)
+{
+    if (t == NULL) {
+	d->ok = 0;
+	return;
+    }
+    dist_add(d, json_num(json_get(t, "median"), 0),
+	     json_num(json_get(t, "stddev"), 0), json_num(json_get(t, "reps"), 0));
+}
+
+/*
+ * welch - Is the difference between the median times of the baseline
+ *     d1 and the current run d2 significant at the 95% level?
+ *     SIG_UNTESTED if either has no distribution.
+ */
+static int welch(dist_t *d1, dist_t *d2)
+{
+    double t, df;
+
+    if (!d1->ok || !d2->ok)
+	return SIG_UNTESTED;
+    if (d1->var + d2->var == 0)
+	return d1->median != d2->median;
+    t = fabs(d1->median - d2->median) / sqrt(d1->var + d2->var);
+    df = (d1->var + d2->var)*(d1->var + d2->var) / (d1->df_den + d2->df_den);
+    return t > ftimer_t95(df);
+}
+
+/*
+ * compare - Print one metric of one trace and return its verdict
+ */
+static int compare(const char *trace, const char *metric, double base,
+		   double cur, int higher_is_better, double threshold,
+		   int significant)
+{
+    double delta = (base != 0) ? cur/base - 1 : 0;
+    double gain = higher_is_better ? delta : -delta;
+    int v;
+
+    if (fabs(delta) <= threshold)
+	v = SAME;
+    else if (significant == SIG_UNTESTED)
+	v = UNTESTED;
+    else if (!significant)
+	v = NOISE;
+    else
+	v = (gain > 0) ? IMPROVED : REGRESSED;
+
+    printf("%-20.20s %-14s%12.6g%12.6g  %s%+7.1f%%%s %s\n",
+	   trace, metric, base, cur,
+	   use_color ? verdict_colors[v] : "",
+	   delta*100,
+	   (use_color && (v == IMPROVED || v == REGRESSED)) ? COLOR_OFF : "",
+	   verdict_names[v]);
+    return v;
+}
+
+/* find the baseline results for the named malloc package */
+static json_t *find_allocator(json_t *doc, const char *name)
+{
+    json_t *r = json_get(doc, "results");
+    int i;
+
+    for (i = 0; i < json_len(r); i++)
+	if (json_string(json_get(json_at(r, i), "allocator")) != NULL
+	    && strcmp(json_string(json_get(json_at(r, i), "allocator")), name) == 0)
+	    return json_at(r, i);
+    return NULL;
+}
+
+/* find the baseline stats for the named trace */
+static json_t *find_trace(json_t *alloc, const char *name)
+{
+    json_t *traces = json_get(alloc, "traces");
+    const char *t;
+    int i;
+
+    for (i = 0; i < json_len(traces); i++) {
+	t = json_string(json_get(json_at(traces, i), "trace"));
+	if (t != NULL && strcmp(t, name) == 0)
+	    return json_at(traces, i);
+    }
+    return NULL;
+}
+
+/*
+ * compare_trace - Compare every metric both runs have for one trace,
+ *     and return the number of regressions. The trace's median times
+ *     are added to btotal and ctotal, for testing the total.
+ */
+static int compare_trace(baseline_opts_t *opts, runinfo_t *info,
+			 const char *name, json_t *bt, stats_t *s,
+			 dist_t *btotal, dist_t *ctotal)
+{
+    int op, regressions = 0;
+    char metric[32];
+    json_t *bl;
+    dist_t bd, cd;
+
+    if (!json_num(json_get(bt, "valid"), 0) || !s->valid) {
+	if (json_num(json_get(bt, "valid"), 0) && !s->valid) {
+	    printf("%-20.20s %-14s%12s%12s  %s\n", name, "valid", "yes", "no",
+		   "REGRESSION");
+	    regressions++;
+	}
+	btotal->ok = ctotal->ok = 0;
+	return regressions;
+    }
+
+    dist_init(&bd);
+    dist_init(&cd);
+    dist_add_json(&bd, json_get(bt, "timing"));
+    if (info->rigorous)
+	dist_add(&cd, s->timing.median, s->timing.stddev, s->timing.reps);
+    else
+	cd.ok = 0;
+    dist_add_json(btotal, json_get(bt, "timing"));
+    if (info->rigorous)
+	dist_add(ctotal, s->timing.median, s->timing.stddev, s->timing.reps);
+    else
+	ctotal->ok = 0;
+    regressions += compare(name, "kops", json_num(json_get(bt, "kops"), 0),
+			   (s->ops/1e3)/s->secs, 1, opts->threshold,
+			   welch(&bd, &cd))
+	== REGRESSED;
+    /* a package without a heap size has null utilization */
+    if (json_num(json_get(bt, "util"), -1) >= 0) {
+	regressions += compare(name, "util", json_num(json_get(bt, "util"), 0),
+			       s->util, 1, opts->threshold, 1) == REGRESSED;
+	regressions += compare(name, "inst_util",
+			       json_num(json_get(bt, "inst_util"), 0),
+			       s->inst_util, 1, opts->threshold, 1) == REGRESSED;
+    }
+
+    if (!info->latency)
+	return regressions;
+    for (op = 0; op < LAT_NOPS; op++) {
+	bl = json_get(json_get(bt, "latency_ns"), lat_op_names[op]);
+	if (json_num(json_get(bl, "count"), 0) == 0 || s->lat[op].count == 0)
+	    continue;
+	sprintf(metric, "%s_p99_ns", lat_op_names[op]);
+	regressions += compare(name, metric, json_num(json_get(bl, "p99"), 0),
+			       s->lat[op].p99, 0, opts->lat_threshold, 1)
+	    == REGRESSED;
+    }
+    return regressions;
+}
+
+/*
+ * compare_baseline - Print how each trace of each malloc package in
+ *     res differs from the baseline, and return the regression count
+ */
+int compare_baseline(const char *path, baseline_opts_t *opts,
+		     runinfo_t *info, results_t *res, int nres)
+{
+    char err[ERRLEN];
+    json_t *doc, *alloc, *bt, *agg;
+    results_t *r;
+    const char *timer;
+    dist_t btotal, ctotal;
+    int i, j, thru_sig, regressions = 0;
+
+    if ((doc = json_load(path, err, ERRLEN)) == NULL) {
+	printf("Could not load baseline %s: %s\n", path, err);
+	return -1;
+    }
+    use_color = isatty(STDOUT_FILENO);
+
+    printf("\nComparison with baseline %s (git %s, threshold %g%%, "
+	   "latency threshold %g%%):\n",
+	   path, json_string(json_path(doc, "build.git")) ?
+	   json_string(json_path(doc, "build.git")) : "?",
+	   opts->threshold*100, opts->lat_threshold*100);
+    timer = json_string(json_path(doc, "run.timer"));
+    if (!info->rigorous || timer == NULL || strncmp(timer, "rigorous", 8))
+	printf("(rerun both with --rigorous to test throughput "
+	       "changes for significance)\n");
+
+    for (i = 0; i < nres; i++) {
+	r = &res[i];
+	if ((alloc = find_allocator(doc, r->name)) == NULL)
+	    continue;
+	printf("%s malloc:\n", r->name);
+	printf("%-20s %-14s%12s%12s  %8s\n",
+	       "trace", "metric", "baseline", "current", "delta");
+	dist_init(&btotal);
+	dist_init(&ctotal);
+	for (j = 0; j < r->n; j++) {
+	    if ((bt = find_trace(alloc, info->tracefiles[j])) == NULL) {
+		btotal.ok = 0;
+		continue;
+	    }
+	    regressions += compare_trace(opts, info, info->tracefiles[j],
+					 bt, &r->stats[j], &btotal, &ctotal);
+	}
+
+	/* the total time is the sum of the traces' medians */
+	agg = json_get(alloc, "aggregate");
+	thru_sig = welch(&btotal, &ctotal);
+	if (r->secs > 0)
+	    regressions += compare("Total", "kops",
+				   json_num(json_get(agg, "kops"), 0),
+				   (r->ops/1e3)/r->secs, 1, opts->threshold,
+				   thru_sig)
+		== REGRESSED;
+	/* the index moves for real if its utilization parts moved, and
+	   otherwise only as much as the throughput is significant */
+	if (r->has_index && json_path(agg, "perf_index.total"))
+	    regressions += compare("Total", "perf_index",
+				   json_num(json_path(agg, "perf_index.total"), 0),
+				   r->perfindex, 1, opts->threshold,
+				   (fabs(json_num(json_path(agg, "perf_index.util"), 0)
+					 - r->p_util*100) > 0.01 ||
+				    fabs(json_num(json_path(agg, "perf_index.inst_util"), 0)
+					 - r->p_inst_util*100) > 0.01)
+				   ? SIG_YES : thru_sig)
+		== REGRESSED;
+    }
+
+    printf("%d regression%s against the baseline\n",
+	   regressions, (regressions == 1) ? "" : "s");
+    json_free(doc);
+    return regressions;
+}
@@ -0,0 +1,21 @@
+/*
+ * baseline.h - Compare a run's results against a run saved earlier
+ *     with --format=json
+ */
+#ifndef __BASELINE_H_
+#define __BASELINE_H_
+
+#include "results.h"
+
+/* Decides when a change from the baseline counts as a regression */
+typedef struct {
+    double threshold;      /* throughput and utilization, as a fraction */
+    double lat_threshold;  /* p99 latency, as a fraction */
+} baseline_opts_t;
+
+/* Print a per-trace comparison of res against the baseline in path.
+   Return the number of regressions found */
+int compare_baseline(const char *path, baseline_opts_t *opts,
+		     runinfo_t *info, results_t *res, int nres);
+
+#endif /* __BASELINE_H_ */
@@ -0,0 +1,136 @@
+/*
+ * calib.c - Cache of libc malloc results per host
+ *
+ * Results are stored under $MDRIVER_CACHE, or else
+ * $XDG_CACHE_HOME/mdriver or ~/.cache/mdriver, in a file named by a
+ * hash of everything that affects libc's speed: the host name, CPU,
+ * kernel, libc version, trace set and timer. A change in any of them
+ * selects a different file, and so forces a new measurement.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include <gnu/libc-version.h>
+
+#include "calib.h"
+
+#define MAXLINE 1024
+
+/* fold a string into a 64-bit FNV-1a hash */
+static uint64_t fnv1a(uint64_t h, const char *s)
+{
+    for (; *s; s++) {
+	h ^= (unsigned char)*s;
+	h *= 0x100000001b3ull;
+    }
+    return h ^ 0xff;  /* separate consecutive strings */
+}
+
+/* find (and create) the cache directory; return 0 on failure */
+static int cache_dir(char *dir, size_t len)
+{
+    char *env, *p;
+
+    if ((env = getenv("MDRIVER_CACHE")) != NULL)
+	snprintf(dir, len, "%s", env);
+    else if ((env = getenv("XDG_CACHE_HOME")) != NULL)
+	snprintf(dir, len, "%s/mdriver", env);
+    else if ((env = getenv("HOME")) != NULL)
+	snprintf(dir, len, "%s/.cache/mdriver", env);
+    else
+	return 0;
+
+    /* mkdir -p */
+    for (p = dir + 1; ; p++) {
+	if (*p != '/' && *p != 0)
+	    continue;
+	char c = *p;
+	*p = 0;
+	if (mkdir(dir, 0755) < 0 && errno != EEXIST)
+	    return 0;
+	*p = c;
+	if (c == 0)
+	    break;
+    }
+    return 1;
+}
+
+/*
+ * calib_path - Name the cache file for this host and trace set
+ */
+char *calib_path(char **tracefiles, int n, const char *tracedir,
+		 const char *timer)
+{
+    char dir[MAXLINE], *path;
+    hostinfo_t host;
+    uint64_t h = 0xcbf29ce484222325ull;
+    int i;
+
+    if (!cache_dir(dir, sizeof(dir)))
+	return NULL;
+
+    get_hostinfo(&host);
+    h = fnv1a(h, host.hostname);
+    h = fnv1a(h, host.cpu);
+    h = fnv1a(h, host.uts.release);
+    h = fnv1a(h, host.uts.machine);
+    h = fnv1a(h, gnu_get_libc_version());
+    h = fnv1a(h, timer);
+    h = fnv1a(h, tracedir);
+    for (i = 0; i < n; i++)
+	h = fnv1a(h, tracefiles[i]);
+
+    if ((path = malloc(strlen(dir) + 32)) == NULL)
+	return NULL;
+    sprintf(path, "%s/libc-%016llx", dir, (unsigned long long)h);
+    return path;
+}
+
+/*
+ * calib_load - Read cached libc results. The file holds a count, then
+ *     one "name valid ops secs" line per trace.
+ */
+int calib_load(const char *path, char **tracefiles, int n, stats_t *stats)
+{
+    FILE *fp;
+    char name[MAXLINE];
+    int i, count, valid;
+
+    if (path == NULL || (fp = fopen(path, "r")) == NULL)
+	return 0;
+    if (fscanf(fp, "%d", &count) != 1 || count != n) {
+	fclose(fp);
+	return 0;
+    }
+    for (i = 0; i < n; i++) {
+	if (fscanf(fp, "%1023s %d %lf %lf", name, &valid, &stats[i].ops,
+		   &stats[i].secs) != 4
+	    || strcmp(name, tracefiles[i]) != 0) {
+	    fclose(fp);
+	    return 0;
+	}
+	stats[i].valid = valid;
+    }
+    fclose(fp);
+    return 1;
+}
+
+/*
+ * calib_save - Write libc results to the cache
+ */
+void calib_save(const char *path, char **tracefiles, int n, stats_t *stats)
+{
+    FILE *fp;
+    int i;
+
+    if (path == NULL || (fp = fopen(path, "w")) == NULL)
+	return;
+    fprintf(fp, "%d\n", n);
+    for (i = 0; i < n; i++)
+	fprintf(fp, "%s %d %.0f %.9g\n", tracefiles[i], stats[i].valid,
+		stats[i].ops, stats[i].secs);
+    fclose(fp);
+}
@@ -0,0 +1,22 @@
+/*
+ * calib.h - Cache of libc malloc throughput measured on this host,
+ *     used in place of AVG_LIBC_THRUPUT by --calibrate
+ */
+#ifndef __CALIB_H_
+#define __CALIB_H_
+
+#include "results.h"
+
+/* Return the cache file for libc results on this host, these traces
+   and this timer, as a malloc'd string */
+char *calib_path(char **tracefiles, int n, const char *tracedir,
+		 const char *timer);
+
+/* Fill in the ops, valid and secs of n stats from the cache file.
+   Return 1 on success, or 0 if it is missing or doesn't match */
+int calib_load(const char *path, char **tracefiles, int n, stats_t *stats);
+
+/* Save the ops, valid and secs of n stats to the cache file */
+void calib_save(const char *path, char **tracefiles, int n, stats_t *stats);
+
+#endif /* __CALIB_H_ */
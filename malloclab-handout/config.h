@@ -40,6 +40,9 @@
  * students surpass the AVG_LIBC_THRUPUT, they get no further benefit
  * to their score.  This deters students from building extremely fast,
  * but extremely stupid malloc packages.
+ *
+ * With --calibrate, libc malloc is instead measured on the same traces
+ * on the current machine, and this constant is not used.
  */
 #define AVG_LIBC_THRUPUT      7500E3  /* 7500 Kops/sec */
 
@@ -51,11 +54,59 @@
 #define UTIL_WEIGHT   .30
 #define UTIL_I_WEIGHT .30
 
+/*
+ * Number of times each trace is replayed when measuring per-op
+ * latency (-L). The histograms accumulate over all of the replays.
+ */
+#define LATENCY_RUNS 10
+
+/*
+ * Number of ops in each of the two windows that a trace is read in
+ * when it is streamed (--stream)
+ */
+#define STREAM_WINDOW 65536
+
+/*
+ * About how many points --series writes for each trace. Longer traces are
+ * sampled evenly, and at their last op.
+ */
+#define SERIES_POINTS 2000
+
+/*
+ * With --layout, mm's pages are mapped at fixed addresses in the
+ * LAYOUT_SIZE bytes from LAYOUT_BASE (or --layout-base), well away
+ * from where the kernel puts mappings of its own choosing, and the
+ * noise pages of memlib are placed with LAYOUT_SEED (or --layout=<seed>).
+ */
+#define LAYOUT_BASE 0x200000000000UL
+#define LAYOUT_SIZE (1UL << 40)
+#define LAYOUT_SEED 1
+
 /* 
  * Alignment requirement in bytes
  */
 #define ALIGNMENT 16
 
+/*
+ * Defaults for the statistically rigorous timing mode (--rigorous),
+ * each of which can be overridden on the command line. Each trace is
+ * run STATS_WARMUP times untimed, then sampled until the 95% confidence
+ * interval of the mean is within STATS_TARGET_CI of the mean, taking
+ * between STATS_MIN_REPS and STATS_MAX_REPS samples.
+ */
+#define STATS_WARMUP    2
+#define STATS_MIN_REPS  5
+#define STATS_MAX_REPS  100
+#define STATS_TARGET_CI 0.01
+
+/*
+ * When comparing with a baseline (--baseline), the default percentage
+ * by which throughput or utilization may drop, and by which p99
+ * latency may grow, before the change is reported as a regression.
+ */
+#define BASELINE_THRESHOLD     5.0
+#define BASELINE_LAT_THRESHOLD 25.0
+
 /*****************************************************************************
  * Set exactly one of these USE_xxx constants to "1" to select a timing method
  *****************************************************************************/
@@ -0,0 +1,282 @@
+/*
+ * evlog.c - Per-thread lock-free event rings, flushed to a file
+ *
+ * Each thread owns a single-producer, single-consumer ring. It writes
+ * events at head and publishes them with a release store; the
+ * flusher thread reads them up to head, writes them out and hands the
+ * slots back by advancing tail. Neither side ever waits for the other:
+ * when the ring is full the thread yields the CPU once, in case the
+ * flusher needs it, and then drops the event and counts it, and an
+ * EV_DROP event tells the reader how many were lost. The flusher
+ * sleeps until a thread has filled a quarter of its ring, rather than
+ * taking the CPU from the threads at a fixed rate. New rings are
+ * pushed onto a list with a compare-and-swap and are never freed, so
+ * the flusher can walk the list at any time.
+ *
+ * A forked child inherits the rings but not the flusher, so it throws
+ * away its copy of its parent's unflushed events and starts its own.
+ * The file is opened with O_APPEND and each block goes out in one
+ * writev, so parent and children can share it.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <sys/uio.h>
+#include <sys/syscall.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "evlog.h"
+
+typedef struct evring {
+    /* The thread's line */
+    _Atomic uint64_t head;       /* next slot the thread writes */
+    uint64_t tail_seen;          /* tail when the thread last read it */
+    uint64_t dropped;            /* events lost since the last EV_DROP */
+    uint64_t heaps;              /* EV_INITs seen, logged or not */
+    int skip;                    /* the current heap is not logged */
+    char pad1[28];
+    /* The flusher's line */
+    _Atomic uint64_t tail;       /* next slot the flusher reads */
+    char pad2[56];
+    uint32_t tid;
+    struct evring *next;
+    ev_t ev[EVLOG_RING];
+} evring_t;
+
+static _Atomic(evring_t *) rings;
+static __thread evring_t *my_ring;
+
+static pthread_once_t once = PTHREAD_ONCE_INIT;
+static int fd = -1;
+static unsigned sample = 1;   /* log one heap in this many */
+static pthread_t flusher;
+static int running;
+static atomic_int stop;
+static pthread_mutex_t wake_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t wake = PTHREAD_COND_INITIALIZER;
+
+static uint64_t ticks(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+#endif
+}
+
+/* write out the events that every ring has published */
+static void drain(void)
+{
+    evring_t *r;
+    evlog_block_t blk;
+    struct iovec iov[3];
+    uint64_t h, t;
+    size_t first;
+
+    for (r = atomic_load_explicit(&rings, memory_order_acquire); r != NULL;
+	 r = r->next) {
+	h = atomic_load_explicit(&r->head, memory_order_acquire);
+	t = atomic_load_explicit(&r->tail, memory_order_relaxed);
+	if (h == t)
+	    continue;
+	blk.pid = getpid();
+	blk.tid = r->tid;
+	blk.count = h - t;
+	blk.pad = 0;
+	first = EVLOG_RING - (t & (EVLOG_RING - 1));
+	if (first > h - t)
+	    first = h - t;
+	iov[0].iov_base = &blk;
+	iov[0].iov_len = sizeof(blk);
+	iov[1].iov_base = &r->ev[t & (EVLOG_RING - 1)];
+	iov[1].iov_len = first * sizeof(ev_t);
+	iov[2].iov_base = &r->ev[0];
+	iov[2].iov_len = (h - t - first) * sizeof(ev_t);
+	if (writev(fd, iov, iov[2].iov_len ? 3 : 2) < 0)
+	    perror("evlog");
+	atomic_store_explicit(&r->tail, h, memory_order_release);
+    }
+}
+
+static void *flush_loop(void *arg)
+{
+    struct timespec ts;
+
+    while (!atomic_load(&stop)) {
+	drain();
+	clock_gettime(CLOCK_REALTIME, &ts);
+	ts.tv_nsec += EVLOG_FLUSH_NS;
+	ts.tv_sec += ts.tv_nsec / 1000000000;
+	ts.tv_nsec %= 1000000000;
+	pthread_mutex_lock(&wake_lock);
+	if (!atomic_load(&stop))
+	    pthread_cond_timedwait(&wake, &wake_lock, &ts);
+	pthread_mutex_unlock(&wake_lock);
+    }
+    return NULL;
+}
+
+static void start_flusher(void)
+{
+    atomic_store(&stop, 0);
+    if (pthread_create(&flusher, NULL, flush_loop, NULL) != 0) {
+	fprintf(stderr, "evlog: could not start the flusher\n");
+	return;
+    }
+    running = 1;
+}
+
+/* in a forked child: the unflushed events are the parent's to write */
+static void after_fork(void)
+{
+    evring_t *r;
+
+    for (r = atomic_load(&rings); r != NULL; r = r->next) {
+	r->tail_seen = atomic_load(&r->head);
+	atomic_store(&r->tail, r->tail_seen);
+    }
+    if (my_ring != NULL)
+	my_ring->tid = syscall(SYS_gettid);
+    running = 0;
+    pthread_mutex_init(&wake_lock, NULL);  /* the parent's flusher may */
+    pthread_cond_init(&wake, NULL);        /* have held them */
+    start_flusher();
+}
+
+/* open the log, time the ticks against the clock and start flushing */
+static void open_log(void)
+{
+    const char *path = getenv("MM_EVLOG");
+    const char *s = getenv("MM_EVLOG_SAMPLE");
+    struct timespec ts = { 0, 10000000 }, c0, c1;
+    evlog_header_t hdr;
+    uint64_t t0;
+
+    if (path == NULL)
+	path = "mm.evlog";
+    sample = s ? atoi(s) : EVLOG_SAMPLE;
+    if ((int)sample < 1)
+	sample = EVLOG_SAMPLE;
+    if ((fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0644)) < 0) {
+	perror(path);
+	return;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &c0);
+    t0 = ticks();
+    nanosleep(&ts, NULL);
+    clock_gettime(CLOCK_MONOTONIC, &c1);
+    memcpy(hdr.magic, EVLOG_MAGIC, sizeof(hdr.magic));
+    hdr.ticks_per_sec = (ticks() - t0) /
+	((c1.tv_sec - c0.tv_sec) + (c1.tv_nsec - c0.tv_nsec) * 1e-9);
+    hdr.sample = sample;
+    hdr.pad = 0;
+    if (write(fd, &hdr, sizeof(hdr)) != sizeof(hdr))
+	perror("evlog");
+
+    start_flusher();
+    pthread_atfork(NULL, NULL, after_fork);
+    atexit(evlog_close);
+}
+
+void evlog_open(void)
+{
+    pthread_once(&once, open_log);
+}
+
+/* the calling thread's first event: give it a ring */
+static evring_t *ring_new(void)
+{
+    evring_t *r;
+
+    evlog_open();
+    if (fd < 0)
+	return NULL;
+    if ((r = aligned_alloc(64, sizeof(evring_t))) == NULL)
+	return NULL;
+    memset(r, 0, sizeof(evring_t));
+    r->tid = syscall(SYS_gettid);
+    r->next = atomic_load(&rings);
+    while (!atomic_compare_exchange_weak(&rings, &r->next, r))
+	;
+    return my_ring = r;
+}
+
+static void put(evring_t *r, uint64_t slot, uint64_t now, int kind,
+		uint64_t addr, uint64_t size, uint64_t block,
+		unsigned long visits)
+{
+    ev_t *e = &r->ev[slot & (EVLOG_RING - 1)];
+
+    if (visits > 0xffff)
+	visits = 0xffff;
+    e->ticks = now;
+    e->addr_kind = (uint64_t)visits << EV_ADDR_BITS | addr | kind;
+    e->size = size;
+    e->block = block;
+}
+
+void evlog_record(int kind, void *addr, size_t size, size_t block,
+		  unsigned long visits)
+{
+    evring_t *r = my_ring;
+    uint64_t h, h0, now;
+
+    if (r == NULL && (r = ring_new()) == NULL)
+	return;
+    if (kind == EV_INIT)
+	r->skip = (r->heaps++ % sample != 0);
+    if (r->skip)
+	return;
+    now = ticks();
+    h = h0 = atomic_load_explicit(&r->head, memory_order_relaxed);
+    /* Room for this and an EV_DROP? The tail only moves forward, so
+       there is at least as much as the last tail read says, and the
+       flusher's line is only read again when that runs out. */
+    if (h - r->tail_seen > EVLOG_RING - 2) {
+	r->tail_seen = atomic_load_explicit(&r->tail, memory_order_acquire);
+	if (h - r->tail_seen > EVLOG_RING - 2 && r->dropped == 0) {
+	    /* the flusher may be waiting for this CPU: give it a turn */
+	    pthread_cond_signal(&wake);
+	    sched_yield();
+	    r->tail_seen = atomic_load_explicit(&r->tail,
+						memory_order_acquire);
+	}
+	if (h - r->tail_seen > EVLOG_RING - 2) {
+	    r->dropped++;
+	    return;
+	}
+    }
+    if (r->dropped) {
+	put(r, h++, now, EV_DROP, 0, r->dropped, 0, 0);
+	r->dropped = 0;
+    }
+    put(r, h++, now, kind, (uintptr_t)addr, size, block, visits);
+    atomic_store_explicit(&r->head, h, memory_order_release);
+    if ((h0 ^ h) & ~(uint64_t)(EVLOG_RING / 4 - 1))  /* a new quarter */
+	pthread_cond_signal(&wake);
+}
+
+void evlog_close(void)
+{
+    if (!running)
+	return;
+    pthread_mutex_lock(&wake_lock);
+    atomic_store(&stop, 1);
+    pthread_cond_signal(&wake);
+    pthread_mutex_unlock(&wake_lock);
+    pthread_join(flusher, NULL);
+    running = 0;
+    drain();
+}
@@ -0,0 +1,100 @@
+/*
+ * evlog.h - A log of allocator events, written by each thread to its
+ *     own lock-free ring and flushed to a file by a background thread.
+ *     mm.c records into it when built with -DMM_EVLOG (make EVLOG=1);
+ *     evscan reads the file back.
+ *
+ *     Each thread logs every event of one in $MM_EVLOG_SAMPLE of its
+ *     heaps (default EVLOG_SAMPLE), starting with the first, and
+ *     nothing of the others. A logged heap is complete, so it can be
+ *     replayed; set MM_EVLOG_SAMPLE=1 to log them all.
+ */
+#ifndef __EVLOG_H_
+#define __EVLOG_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* Event kinds, which must fit in 3 bits */
+enum {
+    EV_INIT,        /* mm_init: a fresh heap, forget everything */
+    EV_MALLOC,      /* addr = payload, size = request, block = block size */
+    EV_FREE,        /* addr = payload, block = block size */
+    EV_MAP,         /* addr, size = a chunk mapped by the allocator */
+    EV_UNMAP,       /* addr, size = a chunk given back */
+    EV_DROP,        /* size = events lost to a full ring before this one */
+    EV_NKINDS
+};
+
+/*
+ * One event, 24 bytes. The kind goes in the low 3 bits of the address,
+ * which are 0 since payloads are 8-byte aligned and chunks page
+ * aligned, and the free blocks visited by the search go in its top 16
+ * bits, which user addresses leave 0. Sizes are 32 bits, as the
+ * driver's requests are ints.
+ */
+typedef struct {
+    uint64_t ticks;      /* timestamp, in the file's ticks_per_sec */
+    uint64_t addr_kind;  /* visits << 48 | addr | kind */
+    uint32_t size;
+    uint32_t block;
+} ev_t;
+
+#define EV_ADDR_BITS 48
+#define EV_KIND(e)   ((int)((e)->addr_kind & 7))
+#define EV_ADDR(e)   ((e)->addr_kind & ((1ULL << EV_ADDR_BITS) - 8))
+#define EV_VISITS(e) ((e)->addr_kind >> EV_ADDR_BITS)
+
+/*
+ * The file is an evlog_header_t followed by blocks, each an
+ * evlog_block_t and its count events, in the order that the flusher
+ * drained them. The events of one thread are in order; the blocks of
+ * different threads and processes are interleaved.
+ */
+#define EVLOG_MAGIC "MMEVLOG2"
+
+typedef struct {
+    char magic[8];
+    double ticks_per_sec;
+    uint32_t sample;     /* one in this many heaps of a thread logged */
+    uint32_t pad;
+} evlog_header_t;
+
+typedef struct {
+    uint32_t pid;
+    uint32_t tid;
+    uint32_t count;
+    uint32_t pad;
+} evlog_block_t;
+
+/* Events per thread ring, a power of 2. A thread wakes the flusher
+   each time it fills a quarter of its ring, and the flusher drains the
+   rings at least every EVLOG_FLUSH_NS regardless. */
+#define EVLOG_RING     (1 << 16)
+#define EVLOG_FLUSH_NS 100000000
+
+/* Heaps per logged heap. A timestamp costs about as much as the rest
+   of an event, and logging every heap slows mm.c down by a third. */
+#define EVLOG_SAMPLE   8
+
+/*
+ * Open the log named by $MM_EVLOG, or mm.evlog, and start the flusher,
+ * if that hasn't been done yet. A process that forks should open it
+ * first, so that its children add to its log instead of replacing it.
+ */
+void evlog_open(void);
+
+/*
+ * Record an event for the calling thread, opening the log if need be.
+ * EV_INIT starts a heap, which decides whether the events up to the
+ * next EV_INIT are logged. Events are dropped, and counted, if the
+ * ring is full.
+ */
+void evlog_record(int kind, void *addr, size_t size, size_t block,
+		  unsigned long visits);
+
+/* Stop the flusher and write out what is left. Call before _exit;
+   exit does it by itself. Does nothing if the log isn't open */
+void evlog_close(void);
+
+#endif /* __EVLOG_H_ */
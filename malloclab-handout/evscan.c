@@ -0,0 +1,402 @@
+/*
+ * evscan.c - Rebuild the heap over time from an event log (evlog.h)
+ *
+ * Usage: evscan [-s <n>] [-m <event>] <log>
+ *
+ * The events of each thread of each process are a stream, and every
+ * EV_INIT in a stream starts a fresh heap. evscan replays each stream,
+ * keeping its live blocks and mapped chunks, and prints for each:
+ *
+ *   the number of heaps, events of each kind and events dropped,
+ *   the mean and longest free list search,
+ *   the peaks of live payload, of the blocks holding it, and of the
+ *   mapped chunks, with the internal fragmentation at that last peak.
+ *
+ * With -s <n> it instead writes a CSV series of the heap of each
+ * stream every <n> of its events. With -m <event> it also draws the
+ * chunks of the heap as it was right after that event (counted over
+ * the whole file, from 0).
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "evlog.h"
+
+#define BAR_CELLS 64     /* width of a chunk in the -m drawing */
+
+/* A live block, in an open-addressed table keyed by address */
+typedef struct {
+    uint64_t addr;       /* 0 if the slot is empty */
+    uint64_t size;       /* payload requested */
+    uint64_t block;      /* block size chosen */
+} live_t;
+
+typedef struct {
+    uint64_t addr, size;
+} chunk_t;
+
+/* The state of one stream */
+typedef struct {
+    uint32_t pid, tid;
+    unsigned long long events, kinds[EV_NKINDS], dropped;
+    unsigned long long visits, max_visits;
+    uint64_t first_ticks, last_ticks;
+
+    live_t *live;        /* the live blocks... */
+    size_t mask, count;  /* ... in mask+1 slots */
+    chunk_t *chunks;     /* the mapped chunks, unordered */
+    int nchunks, maxchunks;
+
+    double live_bytes, block_bytes, mapped;
+    double peak_live, peak_block, peak_mapped, peak_frag;
+} stream_t;
+
+static stream_t *streams;
+static int nstreams, maxstreams;
+static double ticks_per_sec = 1;
+static unsigned sample = 1;  /* one heap in this many was logged */
+
+static void usage(void)
+{
+    fprintf(stderr, "Usage: evscan [-s <n>] [-m <event>] <log>\n");
+    fprintf(stderr, "\t-s <n>      Write the heap every <n> events as CSV.\n");
+    fprintf(stderr, "\t-m <event>  Draw the heap right after event <event>.\n");
+    exit(1);
+}
+
+static void *xrealloc(void *p, size_t n)
+{
+    if ((p = realloc(p, n)) == NULL) {
+	perror("evscan");
+	exit(1);
+    }
+    return p;
+}
+
+/*****************
+ * The live blocks
+ *****************/
+
+static size_t slot_of(stream_t *s, uint64_t addr)
+{
+    return ((addr >> 4) * 0x9e3779b97f4a7c15ULL >> 20) & s->mask;
+}
+
+static void live_clear(stream_t *s)
+{
+    if (s->live == NULL) {
+	s->mask = 1023;
+	s->live = xrealloc(NULL, (s->mask + 1) * sizeof(live_t));
+    }
+    memset(s->live, 0, (s->mask + 1) * sizeof(live_t));
+    s->count = 0;
+}
+
+static live_t *live_find(stream_t *s, uint64_t addr)
+{
+    size_t i;
+
+    for (i = slot_of(s, addr); s->live[i].addr != 0; i = (i + 1) & s->mask)
+	if (s->live[i].addr == addr)
+	    return &s->live[i];
+    return NULL;
+}
+
+static void live_put(stream_t *s, uint64_t addr, uint64_t size,
+		     uint64_t block)
+{
+    live_t *old = s->live;
+    size_t i, n = s->mask + 1;
+
+    if (4 * (s->count + 1) > 3 * n) {
+	/* double the table and put every block back */
+	s->live = xrealloc(NULL, 2 * n * sizeof(live_t));
+	memset(s->live, 0, 2 * n * sizeof(live_t));
+	s->mask = 2 * n - 1;
+	s->count = 0;
+	for (i = 0; i < n; i++)
+	    if (old[i].addr != 0)
+		live_put(s, old[i].addr, old[i].size, old[i].block);
+	free(old);
+    }
+    for (i = slot_of(s, addr); s->live[i].addr != 0; i = (i + 1) & s->mask)
+	;
+    s->live[i].addr = addr;
+    s->live[i].size = size;
+    s->live[i].block = block;
+    s->count++;
+}
+
+/* remove e, shifting the later entries of its run back into the hole */
+static void live_del(stream_t *s, live_t *e)
+{
+    size_t hole = e - s->live, i = hole, home;
+
+    for (;;) {
+	i = (i + 1) & s->mask;
+	if (s->live[i].addr == 0)
+	    break;
+	home = slot_of(s, s->live[i].addr);
+	if (((i - home) & s->mask) >= ((i - hole) & s->mask)) {
+	    s->live[hole] = s->live[i];
+	    hole = i;
+	}
+    }
+    s->live[hole].addr = 0;
+    s->count--;
+}
+
+/*************
+ * The streams
+ *************/
+
+static stream_t *stream_of(uint32_t pid, uint32_t tid)
+{
+    stream_t *s;
+    int i;
+
+    for (i = 0; i < nstreams; i++)
+	if (streams[i].pid == pid && streams[i].tid == tid)
+	    return &streams[i];
+    if (nstreams == maxstreams) {
+	maxstreams = maxstreams ? 2 * maxstreams : 16;
+	streams = xrealloc(streams, maxstreams * sizeof(stream_t));
+    }
+    s = &streams[nstreams++];
+    memset(s, 0, sizeof(*s));
+    s->pid = pid;
+    s->tid = tid;
+    live_clear(s);
+    return s;
+}
+
+/* apply one event to the heap of its stream */
+static void replay(stream_t *s, ev_t *e)
+{
+    live_t *b;
+    int i;
+
+    if (s->events++ == 0)
+	s->first_ticks = e->ticks;
+    s->last_ticks = e->ticks;
+    s->kinds[EV_KIND(e)]++;
+
+    switch (EV_KIND(e)) {
+    case EV_INIT:
+	live_clear(s);
+	s->nchunks = 0;
+	s->live_bytes = s->block_bytes = s->mapped = 0;
+	break;
+    case EV_MALLOC:
+	live_put(s, EV_ADDR(e), e->size, e->block);
+	s->live_bytes += e->size;
+	s->block_bytes += e->block;
+	s->visits += EV_VISITS(e);
+	if (EV_VISITS(e) > s->max_visits)
+	    s->max_visits = EV_VISITS(e);
+	break;
+    case EV_FREE:
+	if ((b = live_find(s, EV_ADDR(e))) != NULL) {
+	    s->live_bytes -= b->size;
+	    s->block_bytes -= b->block;
+	    live_del(s, b);
+	}
+	break;
+    case EV_MAP:
+	if (s->nchunks == s->maxchunks) {
+	    s->maxchunks = s->maxchunks ? 2 * s->maxchunks : 64;
+	    s->chunks = xrealloc(s->chunks, s->maxchunks * sizeof(chunk_t));
+	}
+	s->chunks[s->nchunks].addr = EV_ADDR(e);
+	s->chunks[s->nchunks++].size = e->size;
+	s->mapped += e->size;
+	break;
+    case EV_UNMAP:
+	for (i = 0; i < s->nchunks; i++)
+	    if (s->chunks[i].addr == EV_ADDR(e)) {
+		s->mapped -= s->chunks[i].size;
+		s->chunks[i] = s->chunks[--s->nchunks];
+		break;
+	    }
+	break;
+    case EV_DROP:
+	s->dropped += e->size;
+	break;
+    }
+
+    if (s->live_bytes > s->peak_live)
+	s->peak_live = s->live_bytes;
+    if (s->block_bytes > s->peak_block)
+	s->peak_block = s->block_bytes;
+    if (s->mapped > s->peak_mapped) {
+	s->peak_mapped = s->mapped;
+	s->peak_frag = s->block_bytes > 0 ?
+	    1 - s->live_bytes / s->block_bytes : 0;
+    }
+}
+
+static int by_addr(const void *a, const void *b)
+{
+    const chunk_t *x = a, *y = b;
+
+    return (x->addr > y->addr) - (x->addr < y->addr);
+}
+
+/* draw each chunk of the heap of s as a bar of how full its parts are */
+static void draw(stream_t *s, unsigned long long n)
+{
+    double *cells, cell, lo, hi, from, to;
+    chunk_t *c;
+    size_t i;
+    int lo_i, hi_i, mid, k;
+    const char *shades = " .:#";
+
+    qsort(s->chunks, s->nchunks, sizeof(chunk_t), by_addr);
+    cells = xrealloc(NULL, (s->nchunks + 1) * BAR_CELLS * sizeof(double));
+    memset(cells, 0, (s->nchunks + 1) * BAR_CELLS * sizeof(double));
+
+    /* add the bytes of each live block to the cells it covers */
+    for (i = 0; i <= s->mask; i++) {
+	if (s->live[i].addr == 0)
+	    continue;
+	lo_i = 0;
+	hi_i = s->nchunks - 1;
+	while (lo_i < hi_i) {
+	    mid = (lo_i + hi_i + 1) / 2;
+	    if (s->chunks[mid].addr <= s->live[i].addr)
+		lo_i = mid;
+	    else
+		hi_i = mid - 1;
+	}
+	c = &s->chunks[lo_i];
+	if (s->nchunks == 0 || s->live[i].addr < c->addr ||
+	    s->live[i].addr >= c->addr + c->size)
+	    continue;
+	cell = (double)c->size / BAR_CELLS;
+	lo = s->live[i].addr - c->addr;
+	hi = lo + s->live[i].block;
+	for (k = lo / cell; k < BAR_CELLS && k * cell < hi; k++) {
+	    from = (lo > k * cell) ? lo : k * cell;
+	    to = (hi < (k + 1) * cell) ? hi : (k + 1) * cell;
+	    cells[lo_i * BAR_CELLS + k] += to - from;
+	}
+    }
+
+    printf("Heap of pid %u tid %u after event %llu, at %.6f secs: %.0f live "
+	   "bytes in %zu blocks, %.0f mapped in %d chunks\n", s->pid, s->tid,
+	   n, (s->last_ticks - s->first_ticks) / ticks_per_sec,
+	   s->live_bytes, s->count, s->mapped, s->nchunks);
+    for (lo_i = 0; lo_i < s->nchunks; lo_i++) {
+	c = &s->chunks[lo_i];
+	cell = (double)c->size / BAR_CELLS;
+	for (k = 0, hi = 0; k < BAR_CELLS; k++)
+	    hi += cells[lo_i * BAR_CELLS + k];
+	printf("%#14llx %10llu %5.1f%% |", (unsigned long long)c->addr,
+	       (unsigned long long)c->size, 100.0 * hi / c->size);
+	for (k = 0; k < BAR_CELLS; k++)
+	    putchar(shades[(int)(3.999 * cells[lo_i * BAR_CELLS + k] / cell)]);
+	printf("|\n");
+    }
+    printf("\n");
+    free(cells);
+}
+
+static void summary(void)
+{
+    stream_t *s;
+    int i;
+
+    printf("%7s %7s %6s %10s %10s %10s %8s %8s %7s %6s %10s %10s %10s %5s\n",
+	   "pid", "tid", "heaps", "mallocs", "frees", "secs", "maps",
+	   "unmaps", "dropped", "visits", "peak_live", "peak_block",
+	   "peak_map", "frag");
+    for (i = 0; i < nstreams; i++) {
+	s = &streams[i];
+	printf("%7u %7u %6llu %10llu %10llu %10.4f %8llu %8llu %7llu %6.1f "
+	       "%10.0f %10.0f %10.0f %4.0f%%\n",
+	       s->pid, s->tid, s->kinds[EV_INIT], s->kinds[EV_MALLOC],
+	       s->kinds[EV_FREE],
+	       (s->last_ticks - s->first_ticks) / ticks_per_sec,
+	       s->kinds[EV_MAP], s->kinds[EV_UNMAP], s->dropped,
+	       s->kinds[EV_MALLOC] ? (double)s->visits / s->kinds[EV_MALLOC] : 0,
+	       s->peak_live, s->peak_block, s->peak_mapped,
+	       100.0 * s->peak_frag);
+    }
+    if (sample > 1)
+	printf("Only one heap in %u of each thread was logged; the heaps "
+	       "column counts those.\n", sample);
+    for (i = 0; i < nstreams; i++)
+	if (streams[i].max_visits > 0)
+	    printf("pid %u tid %u: longest search visited %llu free blocks\n",
+		   streams[i].pid, streams[i].tid, streams[i].max_visits);
+}
+
+int main(int argc, char **argv)
+{
+    unsigned long long every = 0, at = 0, n = 0;
+    int c, draw_at = 0;
+    evlog_header_t hdr;
+    evlog_block_t blk;
+    ev_t *evs = NULL;
+    size_t maxevs = 0;
+    stream_t *s;
+    FILE *fp;
+    uint32_t i;
+
+    while ((c = getopt(argc, argv, "s:m:h")) != EOF) {
+	switch (c) {
+	case 's':
+	    every = strtoull(optarg, NULL, 0);
+	    break;
+	case 'm':
+	    at = strtoull(optarg, NULL, 0);
+	    draw_at = 1;
+	    break;
+	default:
+	    usage();
+	}
+    }
+    if (optind != argc - 1)
+	usage();
+    if ((fp = fopen(argv[optind], "rb")) == NULL) {
+	perror(argv[optind]);
+	exit(1);
+    }
+    if (fread(&hdr, sizeof(hdr), 1, fp) != 1 ||
+	memcmp(hdr.magic, EVLOG_MAGIC, sizeof(hdr.magic)) != 0) {
+	fprintf(stderr, "evscan: %s is not an event log\n", argv[optind]);
+	exit(1);
+    }
+    ticks_per_sec = hdr.ticks_per_sec;
+    sample = hdr.sample;
+
+    if (every)
+	printf("pid,tid,event,secs,live_bytes,block_bytes,mapped_bytes,"
+	       "chunks\n");
+    while (fread(&blk, sizeof(blk), 1, fp) == 1) {
+	if (blk.count > maxevs) {
+	    maxevs = blk.count;
+	    evs = xrealloc(evs, maxevs * sizeof(ev_t));
+	}
+	if (fread(evs, sizeof(ev_t), blk.count, fp) != blk.count) {
+	    fprintf(stderr, "evscan: %s is cut short\n", argv[optind]);
+	    break;
+	}
+	s = stream_of(blk.pid, blk.tid);
+	for (i = 0; i < blk.count; i++, n++) {
+	    replay(s, &evs[i]);
+	    if (every && s->events % every == 0)
+		printf("%u,%u,%llu,%.9f,%.0f,%.0f,%.0f,%d\n", s->pid, s->tid,
+		       s->events, (s->last_ticks - s->first_ticks) / ticks_per_sec,
+		       s->live_bytes, s->block_bytes, s->mapped, s->nchunks);
+	    if (draw_at && n == at)
+		draw(s, n);
+	}
+    }
+    fclose(fp);
+    if (!every)
+	summary();
+    exit(0);
+}
@@ -30,6 +30,7 @@ static int compensate = COMPENSATE;
 static int clear_cache = CLEAR_CACHE;
 static int cache_bytes = CACHE_BYTES;
 static int cache_block = CACHE_BLOCK;
+static excluded_funct exclude = NULL;
 
 static int *cache_buf = NULL;
 
@@ -138,6 +139,8 @@ double fcyc(test_funct f, void *argp)
 	    start_comp_counter();
 	    f(argp);
 	    cyc = get_comp_counter();
+	    if (exclude)
+		cyc -= exclude();
 	    add_sample(cyc);
 	} while (!has_converged() && samplecount < maxsamples);
     } else {
@@ -148,6 +151,8 @@ double fcyc(test_funct f, void *argp)
 	    start_counter();
 	    f(argp);
 	    cyc = get_counter();
+	    if (exclude)
+		cyc -= exclude();
 	    add_sample(cyc);
 	} while (!has_converged() && samplecount < maxsamples);
     }
@@ -245,6 +250,16 @@ void set_fcyc_epsilon(double epsilon_arg)
     epsilon = epsilon_arg;
 }
 
+/* 
+ * set_fcyc_exclude - When set, excluded is called after each sample
+ *     and its result is subtracted from that sample
+ *     Default = NULL
+ */
+void set_fcyc_exclude(excluded_funct excluded)
+{
+    exclude = excluded;
+}
+
 
 
 
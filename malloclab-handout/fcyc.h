@@ -10,6 +10,10 @@
 /* The test function takes a generic pointer as input */
 typedef void (*test_funct)(void *);
 
+/* Returns the cycles of the last call of the test function that
+   should not count toward its running time */
+typedef double (*excluded_funct)(void);
+
 /* Compute number of cycles used by test function f */
 double fcyc(test_funct f, void* argp);
 
@@ -63,6 +67,14 @@ void set_fcyc_maxsamples(int maxsamples_arg);
  */
 void set_fcyc_epsilon(double epsilon_arg);
 
+/* 
+ * set_fcyc_exclude - When set, excluded is called after each sample
+ *     and its result is subtracted from that sample, before the
+ *     K best are chosen.
+ *     Default = NULL
+ */
+void set_fcyc_exclude(excluded_funct excluded);
+
 
 
 
@@ -10,8 +10,29 @@
 
 static double Mhz;  /* estimated CPU clock frequency */
 
+/* The function and argument being timed */
+typedef struct {
+    fsecs_test_funct f;
+    void *argp;
+} sample_t;
+
+/* Phase accounting for the function being timed; see fsecs_phase */
+static int cur_phase;                       /* phase being charged */
+static double phase_start;                  /* when cur_phase began */
+static double phase_total[FSECS_NPHASES];   /* over all calls */
+static double call_excluded;                /* non-replay secs, this call */
+static int ncalls;                          /* calls since reset_phases */
+
 extern int verbose; /* -v option in mdriver.c */
 
+#if USE_FCYC
+/* the cycles of the last call spent outside of FSECS_REPLAY */
+static double excluded_cycles(void)
+{
+    return call_excluded*Mhz*1e6;
+}
+#endif
+
 /*
  * init_fsecs - initialize the timing package
  */
@@ -29,6 +50,7 @@ void init_fsecs(void)
     set_fcyc_compensate(1);
     set_fcyc_epsilon(0.01);
     set_fcyc_k(3);
+    set_fcyc_exclude(excluded_cycles);
     Mhz = mhz(verbose > 0);
 #elif USE_ITIMER
     if (verbose)
@@ -40,18 +62,108 @@ void init_fsecs(void)
 }
 
 /*
- * fsecs - Return the running time of a function f (in seconds)
+ * fsecs_phase - Close out the current phase and start charging time
+ *     to the given one
+ */
+void fsecs_phase(int phase)
+{
+    double now = ftimer_now();
+    double elapsed = now - phase_start;
+
+    phase_total[cur_phase] += elapsed;
+    if (cur_phase != FSECS_REPLAY)
+	call_excluded += elapsed;
+    cur_phase = phase;
+    phase_start = now;
+}
+
+/*
+ * fsecs_phase_secs - Report the per-call time spent in each phase
+ */
+void fsecs_phase_secs(double secs[FSECS_NPHASES])
+{
+    int i;
+
+    for (i = 0; i < FSECS_NPHASES; i++)
+	secs[i] = ncalls ? phase_total[i] / ncalls : 0;
+}
+
+/* forget the phase times of the previous measurement */
+static void reset_phases(void)
+{
+    int i;
+
+    for (i = 0; i < FSECS_NPHASES; i++)
+	phase_total[i] = 0;
+    ncalls = 0;
+}
+
+/* call the function under test, tracking its phases */
+static void phased_call(void *ptr)
+{
+    sample_t *s = (sample_t *)ptr;
+
+    call_excluded = 0;
+    cur_phase = FSECS_REPLAY;
+    phase_start = ftimer_now();
+    s->f(s->argp);
+    fsecs_phase(FSECS_REPLAY);
+    ncalls++;
+}
+
+/*
+ * fsecs - Return the running time of a function f (in seconds),
+ *     not counting any time it spends outside of FSECS_REPLAY
  */
 double fsecs(fsecs_test_funct f, void *argp) 
 {
+    sample_t s;
+    double secs;
+
+    s.f = f;
+    s.argp = argp;
+    reset_phases();
 #if USE_FCYC
-    double cycles = fcyc(f, argp);
-    return cycles/(Mhz*1e6);
+    /* fcyc takes each sample minus its own excluded phases, since the
+       mean of the excluded time does not belong to the K best */
+    secs = fcyc(phased_call, &s)/(Mhz*1e6);
 #elif USE_ITIMER
-    return ftimer_itimer(f, argp, 10);
+    secs = ftimer_itimer(phased_call, &s, 10);
 #elif USE_GETTOD
-    return ftimer_gettod(f, argp, 10);
+    secs = ftimer_gettod(phased_call, &s, 10);
 #endif 
+#if !USE_FCYC
+    /* the timers return the mean of the calls, so the mean of their
+       excluded phases comes off */
+    secs -= (phase_total[FSECS_SETUP] + phase_total[FSECS_TEARDOWN])/ncalls;
+#endif
+    return secs;
+}
+
+/* time a single call of the function under test, minus its
+   setup and teardown phases */
+static double sample_once(void *ptr)
+{
+    double start = ftimer_now();
+
+    phased_call(ptr);
+    return ftimer_now() - start - call_excluded;
+}
+
+/*
+ * fsecs_stats - Return the median running time of a function f (in
+ *     seconds), sampled as directed by params. As with fsecs, only the
+ *     FSECS_REPLAY phase counts. The full statistics are stored in *stats.
+ */
+double fsecs_stats(fsecs_test_funct f, void *argp, 
+		   ftimer_params_t *params, ftimer_stats_t *stats)
+{
+    sample_t s;
+
+    s.f = f;
+    s.argp = argp;
+    reset_phases();
+    return ftimer_stats(sample_once, &s, params, stats);
 }
 
 
@@ -1,4 +1,28 @@
+#include "ftimer.h"
+
 typedef void (*fsecs_test_funct)(void *);
 
+/*
+ * A timed function may split itself into phases by calling fsecs_phase.
+ * Only time spent in FSECS_REPLAY (the phase every call starts in) is
+ * counted in the results of fsecs and fsecs_stats.
+ */
+#define FSECS_SETUP    0
+#define FSECS_REPLAY   1
+#define FSECS_TEARDOWN 2
+#define FSECS_NPHASES  3
+
+/* Charge the time from now on to the given phase */
+void fsecs_phase(int phase);
+
+/* Get the average seconds per call spent in each phase during the
+   most recent fsecs or fsecs_stats measurement */
+void fsecs_phase_secs(double secs[FSECS_NPHASES]);
+
 void init_fsecs(void);
 double fsecs(fsecs_test_funct f, void *argp);
+
+/* Time f one call at a time until the results are statistically sound;
+   see ftimer_stats in ftimer.h */
+double fsecs_stats(fsecs_test_funct f, void *argp, 
+		   ftimer_params_t *params, ftimer_stats_t *stats);
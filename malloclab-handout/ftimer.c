@@ -7,14 +7,24 @@
  * Function timers that estimate the running time (in seconds) of a function f.
  *    ftimer_itimer: version that uses the interval timer
  *    ftimer_gettod: version that uses gettimeofday
+ *    ftimer_stats:  version that repeats until the confidence interval
+ *                   of the mean is tight, using ftimer_now
  */
 #include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <time.h>
 #include <sys/time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#include <x86intrin.h>
+#endif
 #include "ftimer.h"
 
 /* function prototypes */
 static void init_etime(void);
 static double get_etime(void);
+static double raw_secs(void);
 
 /* 
  * ftimer_itimer - Use the interval timer to estimate the running time
@@ -52,6 +62,146 @@ double ftimer_gettod(ftimer_test_funct f, void *argp, int n)
     return (1E-3*diff);
 }
 
+/*
+ * Routines for ftimer_now and ftimer_stats
+ */
+
+/* How long to watch the TSC against the raw clock to learn its rate */
+#define TSC_CALIBRATE_SECS 0.05
+
+static int now_clock = FTIMER_RAW;
+static double tsc_secs_per_tick;  /* set when FTIMER_TSC is selected */
+
+/* Two-sided 95% Student t quantiles for 1..30 degrees of freedom */
+static const double t95[] = {
+    12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+    2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+    2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042
+};
+
+/* return the raw monotonic clock in seconds */
+static double raw_secs(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+    return ts.tv_sec + 1E-9*ts.tv_nsec;
+}
+
+/* 
+ * ftimer_set_clock - Select the clock for ftimer_now. The TSC is
+ * calibrated against CLOCK_MONOTONIC_RAW when it is selected.
+ */
+int ftimer_set_clock(int clock)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    unsigned eax, ebx, ecx, edx;
+    unsigned long long start_tick;
+    double start;
+#endif
+
+    if (clock == FTIMER_RAW) {
+	now_clock = FTIMER_RAW;
+	return 0;
+    }
+    if (clock != FTIMER_TSC)
+	return -1;
+
+#if defined(__x86_64__) || defined(__i386__)
+    /* CPUID.80000007H:EDX[8] advertises a constant-rate, non-stop TSC */
+    if (!__get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx) || !(edx & (1 << 8)))
+	return -1;
+    start = raw_secs();
+    start_tick = __rdtsc();
+    while (raw_secs() - start < TSC_CALIBRATE_SECS)
+	;
+    tsc_secs_per_tick = (raw_secs() - start) / (double)(__rdtsc() - start_tick);
+    now_clock = FTIMER_TSC;
+    return 0;
+#else
+    return -1;
+#endif
+}
+
+/* 
+ * ftimer_now - Return the current time in seconds from the selected clock
+ */
+double ftimer_now(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    if (now_clock == FTIMER_TSC)
+	return tsc_secs_per_tick * (double)__rdtsc();
+#endif
+    return raw_secs();
+}
+
+/*
+ * ftimer_t95 - Return the two-sided 95% t quantile for df degrees of
+ * freedom, using the normal value beyond the end of the table
+ */
+double ftimer_t95(double df)
+{
+    int i = (int)df;
+
+    if (i < 1)
+	i = 1;
+    return (i <= 30) ? t95[i - 1] : 1.96;
+}
+
+/* compare doubles for qsort */
+static int cmp_double(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+/* 
+ * ftimer_stats - Run f(argp) params->warmup times untimed, then keep
+ * sampling until the 95% confidence interval of the mean is within
+ * params->target_ci of the mean (or params->max_reps is reached).
+ * Fills in *stats and returns the median sample.
+ */
+double ftimer_stats(ftimer_sample_funct f, void *argp, 
+		    ftimer_params_t *params, ftimer_stats_t *stats)
+{
+    double *samples;
+    double x, delta, mean = 0, m2 = 0, sd = 0, ci = 0;
+    int i, n = 0;
+
+    for (i = 0; i < params->warmup; i++)
+	f(argp);
+
+    if ((samples = malloc(params->max_reps * sizeof(double))) == NULL) {
+	fprintf(stderr, "malloc failed in ftimer_stats\n");
+	exit(1);
+    }
+
+    while (n < params->max_reps) {
+	x = f(argp);
+	samples[n++] = x;
+
+	/* Welford's running mean and variance */
+	delta = x - mean;
+	mean += delta / n;
+	m2 += delta * (x - mean);
+	if (n < 2)
+	    continue;
+	sd = sqrt(m2 / (n - 1));
+	ci = ftimer_t95(n - 1) * sd / sqrt(n);
+	if (n >= params->min_reps && ci <= params->target_ci * mean)
+	    break;
+    }
+
+    qsort(samples, n, sizeof(double), cmp_double);
+    stats->reps = n;
+    stats->min = samples[0];
+    stats->median = (n % 2) ? samples[n/2] : (samples[n/2 - 1] + samples[n/2]) / 2;
+    stats->mean = mean;
+    stats->stddev = sd;
+    stats->ci95 = ci;
+    free(samples);
+    return stats->median;
+}
 
 /*
  * Routines for manipulating the Unix interval timer
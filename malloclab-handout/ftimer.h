@@ -1,3 +1,6 @@
+#ifndef __FTIMER_H_
+#define __FTIMER_H_
+
 /* 
  * Function timers 
  */
@@ -12,3 +15,48 @@ double ftimer_itimer(ftimer_test_funct f, void *argp, int n);
    Return the average of n runs */
 double ftimer_gettod(ftimer_test_funct f, void *argp, int n);
 
+/*
+ * Clocks for ftimer_now. FTIMER_RAW is clock_gettime(CLOCK_MONOTONIC_RAW),
+ * which is not slewed by NTP. FTIMER_TSC reads the x86 time stamp counter
+ * directly and is only accepted when the CPU reports an invariant TSC.
+ */
+#define FTIMER_RAW 0
+#define FTIMER_TSC 1
+
+/* Select the clock used by ftimer_now. Returns -1 if it is unavailable */
+int ftimer_set_clock(int clock);
+
+/* Return the current time, in seconds, from the selected clock */
+double ftimer_now(void);
+
+/* Controls how long ftimer_stats keeps sampling */
+typedef struct {
+    int warmup;        /* untimed runs before sampling starts */
+    int min_reps;      /* always take at least this many samples... */
+    int max_reps;      /* ...and never more than this many */
+    double target_ci;  /* stop once ci95/mean drops to this fraction */
+} ftimer_params_t;
+
+/* Summary of the samples taken by ftimer_stats, all in seconds */
+typedef struct {
+    int reps;          /* number of samples taken */
+    double min;
+    double median;
+    double mean;
+    double stddev;
+    double ci95;       /* half-width of the 95% confidence interval */
+} ftimer_stats_t;
+
+/* A sample function runs the code under test once and returns the
+   number of seconds that count toward the measurement */
+typedef double (*ftimer_sample_funct)(void *); 
+
+/* Return the two-sided 95% quantile of Student's t distribution */
+double ftimer_t95(double df);
+
+/* Take samples of f(argp) until the mean's 95% confidence interval is
+   tight enough, as directed by params. Return the median sample */
+double ftimer_stats(ftimer_sample_funct f, void *argp, 
+		    ftimer_params_t *params, ftimer_stats_t *stats);
+
+#endif /* __FTIMER_H_ */
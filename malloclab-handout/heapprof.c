@@ -0,0 +1,400 @@
+/*
+ * heapprof.c - Sampling heap profiler
+ *
+ * The gaps between samples are drawn from an exponential distribution
+ * with mean rate, so each byte allocated is equally likely to be the
+ * one that triggers a sample, and an allocation of size bytes is
+ * sampled with probability 1 - exp(-size/rate). Dividing by that
+ * probability turns each live sample into an unbiased estimate of the
+ * bytes and objects it stands for.
+ *
+ * The stacks are kept in an array, found by a hash of their frames,
+ * and the live samples in an open-addressed table keyed by address.
+ * Both live in libc's heap, which mm.c does not replace.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <time.h>
+#include <math.h>
+#include <execinfo.h>
+
+#include "heapprof.h"
+
+/* One allocation stack, and the samples taken from it */
+typedef struct {
+    uint64_t hash;
+    int depth;
+    void *frames[HEAPPROF_DEPTH];
+    long live_objs, alloc_objs;        /* samples live, and ever taken */
+    long long live_bytes, alloc_bytes; /* their sizes */
+} prof_stack_t;
+
+/* One live sample */
+typedef struct {
+    void *ptr;           /* NULL if the slot is empty */
+    size_t size;
+    int stack;           /* index into stacks */
+} sample_t;
+
+long heapprof_countdown;
+
+static long rate;        /* 0 until the first call of heapprof_sample */
+static uint64_t rng;
+
+static prof_stack_t *stacks;
+static int nstacks, maxstacks;
+static int *stack_slots;  /* stack indices by hash, -1 if empty */
+static size_t stack_mask;
+
+static sample_t *samples;
+static size_t sample_mask, nsamples;
+
+static void *xcalloc(size_t n, size_t size)
+{
+    void *p = calloc(n, size);
+
+    if (p == NULL) {
+	perror("heapprof");
+	exit(1);
+    }
+    return p;
+}
+
+/* the bytes until the next sample: exponential, mean rate */
+static long next_gap(void)
+{
+    double u;
+
+    rng ^= rng >> 12;
+    rng ^= rng << 25;
+    rng ^= rng >> 27;
+    u = ((rng * 0x2545f4914f6cdd1dULL) >> 11) * (1.0 / 9007199254740992.0);
+    return (long)(-log(1.0 - u) * rate) + 1;
+}
+
+/* the estimated number of allocations that a sample of size stands for */
+static double scale(double size)
+{
+    return 1.0 / (1.0 - exp(-size / rate));
+}
+
+/*************************
+ * Stacks and live samples
+ *************************/
+
+static int find_stack(void **frames, int depth)
+{
+    uint64_t h = 14695981039346656037ULL;
+    prof_stack_t *s;
+    size_t i;
+    int k, *old;
+
+    for (k = 0; k < depth; k++)
+	h = (h ^ (uintptr_t)frames[k]) * 1099511628211ULL;
+
+    for (i = h & stack_mask; stack_slots[i] >= 0; i = (i + 1) & stack_mask) {
+	s = &stacks[stack_slots[i]];
+	if (s->hash == h && s->depth == depth &&
+	    memcmp(s->frames, frames, depth * sizeof(void *)) == 0)
+	    return stack_slots[i];
+    }
+
+    if (nstacks == maxstacks) {
+	maxstacks *= 2;
+	if ((stacks = realloc(stacks, maxstacks * sizeof(prof_stack_t))) == NULL) {
+	    perror("heapprof");
+	    exit(1);
+	}
+    }
+    s = &stacks[nstacks];
+    memset(s, 0, sizeof(*s));
+    s->hash = h;
+    s->depth = depth;
+    memcpy(s->frames, frames, depth * sizeof(void *));
+    stack_slots[i] = nstacks++;
+
+    if (2 * nstacks > stack_mask + 1) {
+	/* double the slots and hash the stacks again */
+	old = stack_slots;
+	stack_slots = xcalloc(2 * (stack_mask + 1), sizeof(int));
+	memset(stack_slots, -1, 2 * (stack_mask + 1) * sizeof(int));
+	free(old);
+	stack_mask = 2 * stack_mask + 1;
+	for (k = 0; k < nstacks; k++) {
+	    for (i = stacks[k].hash & stack_mask; stack_slots[i] >= 0;
+		 i = (i + 1) & stack_mask)
+		;
+	    stack_slots[i] = k;
+	}
+    }
+    return nstacks - 1;
+}
+
+static size_t slot_of(void *p)
+{
+    return (((uintptr_t)p >> 4) * 0x9e3779b97f4a7c15ULL >> 20) & sample_mask;
+}
+
+static sample_t *find_sample(void *p)
+{
+    size_t i;
+
+    for (i = slot_of(p); samples[i].ptr != NULL; i = (i + 1) & sample_mask)
+	if (samples[i].ptr == p)
+	    return &samples[i];
+    return NULL;
+}
+
+/* remove e, shifting the later entries of its run back into the hole */
+static void remove_sample(sample_t *e)
+{
+    size_t hole = e - samples, i = hole, home;
+
+    stacks[e->stack].live_objs--;
+    stacks[e->stack].live_bytes -= e->size;
+    for (;;) {
+	i = (i + 1) & sample_mask;
+	if (samples[i].ptr == NULL)
+	    break;
+	home = slot_of(samples[i].ptr);
+	if (((i - home) & sample_mask) >= ((i - hole) & sample_mask)) {
+	    samples[hole] = samples[i];
+	    hole = i;
+	}
+    }
+    samples[hole].ptr = NULL;
+    nsamples--;
+}
+
+static void add_sample(void *p, size_t size, int stack)
+{
+    sample_t *old = samples;
+    size_t i, n = sample_mask + 1;
+
+    if (4 * (nsamples + 1) > 3 * n) {
+	samples = xcalloc(2 * n, sizeof(sample_t));
+	sample_mask = 2 * n - 1;
+	nsamples = 0;
+	for (i = 0; i < n; i++)
+	    if (old[i].ptr != NULL) {
+		stacks[old[i].stack].live_objs--;
+		stacks[old[i].stack].live_bytes -= old[i].size;
+		add_sample(old[i].ptr, old[i].size, old[i].stack);
+	    }
+	free(old);
+    }
+    for (i = slot_of(p); samples[i].ptr != NULL; i = (i + 1) & sample_mask)
+	;
+    samples[i].ptr = p;
+    samples[i].size = size;
+    samples[i].stack = stack;
+    nsamples++;
+    stacks[stack].live_objs++;
+    stacks[stack].live_bytes += size;
+}
+
+/**************
+ * The sampler
+ **************/
+
+static void dump_at_exit(void)
+{
+    const char *path = getenv("MM_HEAPPROF");
+    const char *format = getenv("MM_HEAPPROF_FORMAT");
+    FILE *fp;
+
+    if (path == NULL)
+	path = "mm.heap";
+    if ((fp = fopen(path, "w")) == NULL) {
+	perror(path);
+	return;
+    }
+    heapprof_dump(fp, (format && strcmp(format, "pprof") == 0) ?
+		  HEAPPROF_PPROF : HEAPPROF_TEXT);
+    fclose(fp);
+}
+
+static void start(void)
+{
+    const char *s = getenv("MM_HEAPPROF_RATE");
+    void *frames[1];
+
+    rate = s ? atol(s) : HEAPPROF_RATE;
+    if (rate < 1)
+	rate = HEAPPROF_RATE;
+    rng = ((uint64_t)time(NULL) << 20) ^ getpid() ^ 0x9e3779b97f4a7c15ULL;
+
+    maxstacks = 256;
+    stacks = xcalloc(maxstacks, sizeof(prof_stack_t));
+    stack_mask = 1023;
+    stack_slots = xcalloc(stack_mask + 1, sizeof(int));
+    memset(stack_slots, -1, (stack_mask + 1) * sizeof(int));
+    sample_mask = 1023;
+    samples = xcalloc(sample_mask + 1, sizeof(sample_t));
+
+    backtrace(frames, 1);  /* its first call allocates; not in a sample */
+    atexit(dump_at_exit);
+}
+
+int heapprof_sample(void *p, size_t size)
+{
+    void *frames[HEAPPROF_DEPTH + 1];
+    sample_t *e;
+    int depth, stack;
+
+    if (rate == 0) {
+	start();
+	heapprof_countdown = next_gap();
+	return 0;
+    }
+    heapprof_countdown = next_gap();
+
+    /* leave out this function's own frame */
+    depth = backtrace(frames, HEAPPROF_DEPTH + 1) - 1;
+    stack = find_stack(frames + 1, depth);
+    stacks[stack].alloc_objs++;
+    stacks[stack].alloc_bytes += size;
+
+    /* a block that was never freed, whose heap was reset under it */
+    if ((e = find_sample(p)) != NULL)
+	remove_sample(e);
+    add_sample(p, size, stack);
+    return 1;
+}
+
+void heapprof_free(void *p)
+{
+    sample_t *e;
+
+    if (rate != 0 && (e = find_sample(p)) != NULL)
+	remove_sample(e);
+}
+
+void heapprof_reset(void)
+{
+    int k;
+
+    if (rate == 0)
+	return;
+    memset(samples, 0, (sample_mask + 1) * sizeof(sample_t));
+    nsamples = 0;
+    for (k = 0; k < nstacks; k++) {
+	stacks[k].live_objs = 0;
+	stacks[k].live_bytes = 0;
+    }
+}
+
+/*************
+ * The output
+ *************/
+
+/* the estimated live bytes of each stack, filled in by estimate */
+static double *est_bytes, *est_objs;
+
+static int by_est_bytes(const void *a, const void *b)
+{
+    double x = est_bytes[*(const int *)a], y = est_bytes[*(const int *)b];
+
+    return (x < y) - (x > y);
+}
+
+/* scale each live sample up by the chance that it was taken */
+static void estimate(void)
+{
+    size_t i;
+
+    est_bytes = xcalloc(nstacks + 1, sizeof(double));
+    est_objs = xcalloc(nstacks + 1, sizeof(double));
+    for (i = 0; i <= sample_mask && rate != 0; i++) {
+	if (samples[i].ptr == NULL)
+	    continue;
+	est_objs[samples[i].stack] += scale(samples[i].size);
+	est_bytes[samples[i].stack] += samples[i].size * scale(samples[i].size);
+    }
+}
+
+/* the live samples as plain text, biggest stack first */
+static void dump_text(FILE *fp)
+{
+    double bytes = 0, objs = 0;
+    int *order, k, f;
+    char **names;
+    prof_stack_t *s;
+
+    estimate();
+    order = xcalloc(nstacks + 1, sizeof(int));
+    for (k = 0; k < nstacks; k++) {
+	order[k] = k;
+	bytes += est_bytes[k];
+	objs += est_objs[k];
+    }
+    qsort(order, nstacks, sizeof(int), by_est_bytes);
+
+    fprintf(fp, "Heap profile: about %.0f live bytes in %.0f objects, from "
+	    "%zu samples, one every %ld bytes on average\n\n",
+	    bytes, objs, nsamples, rate);
+    fprintf(fp, "%12s %10s %6s %10s  stack\n", "bytes", "objects", "share",
+	    "avg_size");
+    for (k = 0; k < nstacks && est_bytes[order[k]] > 0; k++) {
+	s = &stacks[order[k]];
+	fprintf(fp, "%12.0f %10.0f %5.1f%% %10.0f\n", est_bytes[order[k]],
+		est_objs[order[k]], 100.0 * est_bytes[order[k]] / bytes,
+		(double)s->live_bytes / s->live_objs);
+	if ((names = backtrace_symbols(s->frames, s->depth)) == NULL)
+	    continue;
+	for (f = 0; f < s->depth; f++)
+	    fprintf(fp, "%43s%s\n", "", names[f]);
+	free(names);
+    }
+    free(order);
+    free(est_bytes);
+    free(est_objs);
+}
+
+/* the samples in the text heap profile format of gperftools, which
+   pprof reads and unsamples itself from the rate */
+static void dump_pprof(FILE *fp)
+{
+    long live_objs = 0, alloc_objs = 0;
+    long long live_bytes = 0, alloc_bytes = 0;
+    prof_stack_t *s;
+    FILE *maps;
+    char line[4096];
+    int k, f;
+
+    for (k = 0; k < nstacks; k++) {
+	live_objs += stacks[k].live_objs;
+	live_bytes += stacks[k].live_bytes;
+	alloc_objs += stacks[k].alloc_objs;
+	alloc_bytes += stacks[k].alloc_bytes;
+    }
+    fprintf(fp, "heap profile: %ld: %lld [%ld: %lld] @ heap_v2/%ld\n",
+	    live_objs, live_bytes, alloc_objs, alloc_bytes, rate);
+    for (k = 0; k < nstacks; k++) {
+	s = &stacks[k];
+	fprintf(fp, "%ld: %lld [%ld: %lld] @", s->live_objs, s->live_bytes,
+		s->alloc_objs, s->alloc_bytes);
+	for (f = 0; f < s->depth; f++)
+	    fprintf(fp, " %p", s->frames[f]);
+	fprintf(fp, "\n");
+    }
+
+    /* pprof needs the mappings to find the symbols */
+    fprintf(fp, "\nMAPPED_LIBRARIES:\n");
+    if ((maps = fopen("/proc/self/maps", "r")) != NULL) {
+	while (fgets(line, sizeof(line), maps) != NULL)
+	    fputs(line, fp);
+	fclose(maps);
+    }
+}
+
+void heapprof_dump(FILE *fp, int format)
+{
+    if (format == HEAPPROF_PPROF)
+	dump_pprof(fp);
+    else
+	dump_text(fp);
+}
@@ -0,0 +1,50 @@
+/*
+ * heapprof.h - A sampling heap profiler for mm.c, built in with
+ *     -DMM_HEAPPROF (make HEAPPROF=1)
+ *
+ * Allocations are sampled by a Poisson process on the bytes allocated:
+ * on average one sample every $MM_HEAPPROF_RATE bytes (default
+ * HEAPPROF_RATE). A sample keeps the size and the stack of the
+ * allocation until it is freed. At exit, or on heapprof_dump, the
+ * live samples are scaled up into an estimate of the whole live heap,
+ * by stack, and written to $MM_HEAPPROF (default mm.heap) as text, or
+ * for pprof if $MM_HEAPPROF_FORMAT is "pprof".
+ *
+ * Not thread-safe; neither is mm.c.
+ */
+#ifndef __HEAPPROF_H_
+#define __HEAPPROF_H_
+
+#include <stdio.h>
+#include <stddef.h>
+
+#define HEAPPROF_RATE  (512 * 1024)  /* mean bytes between samples */
+#define HEAPPROF_DEPTH 32            /* most frames kept per stack */
+
+/* Output formats of heapprof_dump */
+#define HEAPPROF_TEXT  0
+#define HEAPPROF_PPROF 1
+
+/*
+ * Bytes left before the next sample. The allocator subtracts the size
+ * of each allocation, and calls heapprof_sample once it goes negative:
+ *
+ *     if ((heapprof_countdown -= size) < 0 && heapprof_sample(p, size))
+ *         mark p as sampled
+ */
+extern long heapprof_countdown;
+
+/* Take a sample of the allocation p of size bytes, and start the next
+   countdown. Returns 1 if p is now sampled, 0 if it was not taken */
+int heapprof_sample(void *p, size_t size);
+
+/* p, which was sampled, is being freed */
+void heapprof_free(void *p);
+
+/* Forget the live samples, whose heap is gone */
+void heapprof_reset(void);
+
+/* Write the estimated live heap in a HEAPPROF_xxx format */
+void heapprof_dump(FILE *fp, int format);
+
+#endif /* __HEAPPROF_H_ */
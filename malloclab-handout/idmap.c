@@ -0,0 +1,147 @@
+/*
+ * idmap.c - Sparse map from block ids to live blocks
+ *
+ * Linear probing, with deletion by shifting later entries of the same
+ * run back into the hole, so there are no tombstones and a lookup
+ * stops at the first empty slot. The table doubles when it is 3/4
+ * full and never shrinks, so its size follows the peak live set
+ * rather than the number of ids in the trace.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "idmap.h"
+
+#define IDMAP_MIN_SLOTS 1024
+
+/* the home slot of id */
+static size_t slot_of(idmap_t *m, int id)
+{
+    return ((uint32_t)id * 2654435761u) & m->mask;
+}
+
+/* allocate n empty slots */
+static idmap_entry_t *alloc_slots(size_t n)
+{
+    idmap_entry_t *slots;
+    size_t i;
+
+    if ((slots = malloc(n * sizeof(idmap_entry_t))) == NULL) {
+	perror("idmap");
+	exit(1);
+    }
+    for (i = 0; i < n; i++)
+	slots[i].id = -1;
+    return slots;
+}
+
+/* double the number of slots and rehash the live blocks */
+static void grow(idmap_t *m)
+{
+    idmap_entry_t *old = m->slots;
+    size_t i, j, n = m->mask + 1;
+
+    m->slots = alloc_slots(2 * n);
+    m->mask = 2 * n - 1;
+    for (i = 0; i < n; i++) {
+	if (old[i].id < 0)
+	    continue;
+	for (j = slot_of(m, old[i].id); m->slots[j].id >= 0;
+	     j = (j + 1) & m->mask)
+	    ;
+	m->slots[j] = old[i];
+    }
+    free(old);
+}
+
+/*
+ * idmap_init - Create an empty map
+ */
+void idmap_init(idmap_t *m)
+{
+    m->slots = alloc_slots(IDMAP_MIN_SLOTS);
+    m->mask = IDMAP_MIN_SLOTS - 1;
+    m->count = 0;
+}
+
+/*
+ * idmap_free - Free the slots of a map
+ */
+void idmap_free(idmap_t *m)
+{
+    free(m->slots);
+    m->slots = NULL;
+    m->mask = m->count = 0;
+}
+
+/*
+ * idmap_clear - Remove every entry
+ */
+void idmap_clear(idmap_t *m)
+{
+    size_t i;
+
+    if (m->count == 0)
+	return;
+    for (i = 0; i <= m->mask; i++)
+	m->slots[i].id = -1;
+    m->count = 0;
+}
+
+/*
+ * idmap_get - Find the entry for id
+ */
+idmap_entry_t *idmap_get(idmap_t *m, int id)
+{
+    size_t i;
+
+    for (i = slot_of(m, id); m->slots[i].id >= 0; i = (i + 1) & m->mask)
+	if (m->slots[i].id == id)
+	    return &m->slots[i];
+    return NULL;
+}
+
+/*
+ * idmap_put - Find the entry for id, or add an empty one
+ */
+idmap_entry_t *idmap_put(idmap_t *m, int id)
+{
+    size_t i;
+
+    if (4 * (m->count + 1) > 3 * (m->mask + 1))
+	grow(m);
+    for (i = slot_of(m, id); m->slots[i].id >= 0; i = (i + 1) & m->mask)
+	if (m->slots[i].id == id)
+	    return &m->slots[i];
+    m->slots[i].id = id;
+    m->slots[i].size = 0;
+    m->slots[i].ptr = NULL;
+    m->count++;
+    return &m->slots[i];
+}
+
+/*
+ * idmap_del - Remove the entry for id, moving back any entries that
+ *     were displaced past it
+ */
+void idmap_del(idmap_t *m, int id)
+{
+    idmap_entry_t *e = idmap_get(m, id);
+    size_t hole, i, home;
+
+    if (e == NULL)
+	return;
+    hole = e - m->slots;
+    for (i = (hole + 1) & m->mask; m->slots[i].id >= 0;
+	 i = (i + 1) & m->mask) {
+	/* move slot i into the hole unless its home lies in (hole, i] */
+	home = slot_of(m, m->slots[i].id);
+	if (((i - home) & m->mask) >= ((i - hole) & m->mask)) {
+	    m->slots[hole] = m->slots[i];
+	    hole = i;
+	}
+    }
+    m->slots[hole].id = -1;
+    m->count--;
+}
@@ -0,0 +1,39 @@
+/*
+ * idmap.h - Sparse map from trace block ids to the live blocks, used
+ *     in place of the blocks and block_sizes arrays when streaming
+ */
+#ifndef __IDMAP_H_
+#define __IDMAP_H_
+
+#include <stddef.h>
+
+/* One live block */
+typedef struct {
+    int id;              /* trace block id, or -1 if the slot is empty */
+    int size;            /* payload size in bytes */
+    char *ptr;           /* payload returned by the allocator */
+} idmap_entry_t;
+
+/* An open-addressed hash table of the live blocks */
+typedef struct {
+    idmap_entry_t *slots;
+    size_t mask;         /* number of slots - 1, a power of 2 minus 1 */
+    size_t count;        /* number of live blocks */
+} idmap_t;
+
+void idmap_init(idmap_t *m);
+void idmap_free(idmap_t *m);
+
+/* Empty the map, keeping its slots for reuse */
+void idmap_clear(idmap_t *m);
+
+/* Return the entry for id, or NULL if it isn't live */
+idmap_entry_t *idmap_get(idmap_t *m, int id);
+
+/* Return the entry for id, adding it if it isn't live */
+idmap_entry_t *idmap_put(idmap_t *m, int id);
+
+/* Remove id from the map, if it is there */
+void idmap_del(idmap_t *m, int id);
+
+#endif /* __IDMAP_H_ */
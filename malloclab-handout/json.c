@@ -0,0 +1,363 @@
+/*
+ * json.c - A small recursive-descent JSON reader
+ *
+ * Numbers are kept as doubles, and \u escapes outside of ASCII are
+ * replaced by '?', which is all that mdriver's own output needs.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "json.h"
+
+#define MAXDEPTH 64   /* deepest nesting accepted */
+
+/* Parser state */
+typedef struct {
+    const char *p;     /* next character to read */
+    char *err;         /* where to put an error message */
+    size_t errlen;
+    int depth;
+} parser_t;
+
+static json_t *parse_value(parser_t *ps);
+
+/* record the first error, return NULL */
+static json_t *fail(parser_t *ps, const char *what)
+{
+    if (ps->err && !ps->err[0])
+	snprintf(ps->err, ps->errlen, "%s near \"%.16s\"", what, ps->p);
+    return NULL;
+}
+
+static void skip_ws(parser_t *ps)
+{
+    while (isspace((unsigned char)*ps->p))
+	ps->p++;
+}
+
+static json_t *new_value(json_type_t type)
+{
+    json_t *v = calloc(1, sizeof(json_t));
+
+    if (v == NULL) {
+	fprintf(stderr, "calloc failed in json reader\n");
+	exit(1);
+    }
+    v->type = type;
+    return v;
+}
+
+/* parse a string literal; ps->p is at the opening quote */
+static char *parse_string(parser_t *ps)
+{
+    const char *s = ps->p + 1, *e;
+    char *out, *q;
+    unsigned code;
+
+    /* the decoded string is never longer than the literal */
+    for (e = s; *e && *e != '"'; e++)
+	if (*e == '\\' && e[1])
+	    e++;
+    if (*e != '"') {
+	fail(ps, "unterminated string");
+	return NULL;
+    }
+    if ((out = malloc(e - s + 1)) == NULL) {
+	fprintf(stderr, "malloc failed in json reader\n");
+	exit(1);
+    }
+
+    for (q = out; *s != '"'; s++) {
+	if (*s != '\\') {
+	    *q++ = *s;
+	    continue;
+	}
+	switch (*++s) {
+	case 'b': *q++ = '\b'; break;
+	case 'f': *q++ = '\f'; break;
+	case 'n': *q++ = '\n'; break;
+	case 'r': *q++ = '\r'; break;
+	case 't': *q++ = '\t'; break;
+	case 'u':
+	    if (sscanf(s + 1, "%4x", &code) != 1) {
+		free(out);
+		fail(ps, "bad \\u escape");
+		return NULL;
+	    }
+	    *q++ = (code < 0x80) ? (char)code : '?';
+	    s += 4;
+	    break;
+	default: *q++ = *s; break;
+	}
+    }
+    *q = 0;
+    ps->p = s + 1;
+    return out;
+}
+
+/* parse the members of an array or object; ps->p is past the bracket */
+static json_t *parse_container(parser_t *ps, json_type_t type)
+{
+    json_t *v = new_value(type), **tail = &v->child, *m;
+    char close = (type == JSON_ARRAY) ? ']' : '}';
+    char *key = NULL;
+
+    if (++ps->depth > MAXDEPTH) {
+	json_free(v);
+	return fail(ps, "nesting too deep");
+    }
+    skip_ws(ps);
+    if (*ps->p == close) {
+	ps->p++;
+	ps->depth--;
+	return v;
+    }
+    for (;;) {
+	skip_ws(ps);
+	if (type == JSON_OBJECT) {
+	    if (*ps->p != '"' || (key = parse_string(ps)) == NULL) {
+		json_free(v);
+		return fail(ps, "expected member name");
+	    }
+	    skip_ws(ps);
+	    if (*ps->p++ != ':') {
+		free(key);
+		json_free(v);
+		return fail(ps, "expected ':'");
+	    }
+	}
+	if ((m = parse_value(ps)) == NULL) {
+	    free(key);
+	    json_free(v);
+	    return NULL;
+	}
+	m->key = key;
+	key = NULL;
+	*tail = m;
+	tail = &m->next;
+
+	skip_ws(ps);
+	if (*ps->p == ',') {
+	    ps->p++;
+	    continue;
+	}
+	if (*ps->p == close) {
+	    ps->p++;
+	    ps->depth--;
+	    return v;
+	}
+	json_free(v);
+	return fail(ps, "expected ',' or closing bracket");
+    }
+}
+
+/* parse any value */
+static json_t *parse_value(parser_t *ps)
+{
+    json_t *v;
+    char *end;
+
+    skip_ws(ps);
+    switch (*ps->p) {
+    case '{':
+	ps->p++;
+	return parse_container(ps, JSON_OBJECT);
+    case '[':
+	ps->p++;
+	return parse_container(ps, JSON_ARRAY);
+    case '"':
+	v = new_value(JSON_STRING);
+	if ((v->str = parse_string(ps)) == NULL) {
+	    free(v);
+	    return NULL;
+	}
+	return v;
+    case 't':
+    case 'f':
+    case 'n':
+	if (strncmp(ps->p, "true", 4) == 0) {
+	    v = new_value(JSON_BOOL);
+	    v->num = 1;
+	    ps->p += 4;
+	}
+	else if (strncmp(ps->p, "false", 5) == 0) {
+	    v = new_value(JSON_BOOL);
+	    ps->p += 5;
+	}
+	else if (strncmp(ps->p, "null", 4) == 0) {
+	    v = new_value(JSON_NULL);
+	    ps->p += 4;
+	}
+	else
+	    return fail(ps, "unknown literal");
+	return v;
+    default:
+	v = new_value(JSON_NUMBER);
+	v->num = strtod(ps->p, &end);
+	if (end == ps->p) {
+	    free(v);
+	    return fail(ps, "unexpected character");
+	}
+	ps->p = end;
+	return v;
+    }
+}
+
+/*
+ * json_parse - Parse a complete JSON document held in a string
+ */
+json_t *json_parse(const char *text, char *err, size_t errlen)
+{
+    parser_t ps;
+    json_t *v;
+
+    ps.p = text;
+    ps.err = err;
+    ps.errlen = errlen;
+    ps.depth = 0;
+    if (err && errlen)
+	err[0] = 0;
+
+    if ((v = parse_value(&ps)) == NULL)
+	return NULL;
+    skip_ws(&ps);
+    if (*ps.p) {
+	json_free(v);
+	return fail(&ps, "trailing characters");
+    }
+    return v;
+}
+
+/*
+ * json_load - Read and parse a JSON file
+ */
+json_t *json_load(const char *path, char *err, size_t errlen)
+{
+    FILE *fp;
+    char *text;
+    long len;
+    json_t *v;
+
+    if ((fp = fopen(path, "r")) == NULL) {
+	snprintf(err, errlen, "could not open %s", path);
+	return NULL;
+    }
+    fseek(fp, 0, SEEK_END);
+    len = ftell(fp);
+    rewind(fp);
+    if (len < 0 || (text = malloc(len + 1)) == NULL) {
+	fclose(fp);
+	snprintf(err, errlen, "could not read %s", path);
+	return NULL;
+    }
+    len = fread(text, 1, len, fp);
+    text[len] = 0;
+    fclose(fp);
+
+    v = json_parse(text, err, errlen);
+    free(text);
+    return v;
+}
+
+/*
+ * json_free - Free a value and everything inside it
+ */
+void json_free(json_t *v)
+{
+    json_t *next;
+
+    while (v) {
+	next = v->next;
+	json_free(v->child);
+	free(v->key);
+	free(v->str);
+	free(v);
+	v = next;
+    }
+}
+
+/*
+ * json_get - Look up a member of an object by name
+ */
+json_t *json_get(json_t *obj, const char *key)
+{
+    json_t *m;
+
+    if (obj == NULL || obj->type != JSON_OBJECT)
+	return NULL;
+    for (m = obj->child; m; m = m->next)
+	if (strcmp(m->key, key) == 0)
+	    return m;
+    return NULL;
+}
+
+/*
+ * json_path - Follow a dotted chain of member names, as in "timing.mean"
+ */
+json_t *json_path(json_t *obj, const char *path)
+{
+    char name[256];
+    size_t n;
+
+    while (obj && *path) {
+	n = strcspn(path, ".");
+	if (n >= sizeof(name))
+	    return NULL;
+	memcpy(name, path, n);
+	name[n] = 0;
+	obj = json_get(obj, name);
+	path += n + (path[n] == '.');
+    }
+    return obj;
+}
+
+/*
+ * json_at - Return element i of an array
+ */
+json_t *json_at(json_t *arr, int i)
+{
+    json_t *m;
+
+    if (arr == NULL || arr->type != JSON_ARRAY)
+	return NULL;
+    for (m = arr->child; m && i > 0; m = m->next)
+	i--;
+    return m;
+}
+
+/*
+ * json_len - Return the number of elements in an array
+ */
+int json_len(json_t *arr)
+{
+    json_t *m;
+    int n = 0;
+
+    if (arr == NULL || arr->type != JSON_ARRAY)
+	return 0;
+    for (m = arr->child; m; m = m->next)
+	n++;
+    return n;
+}
+
+/*
+ * json_num - Return a number (or boolean) value, or dflt
+ */
+double json_num(json_t *v, double dflt)
+{
+    if (v == NULL || (v->type != JSON_NUMBER && v->type != JSON_BOOL))
+	return dflt;
+    return v->num;
+}
+
+/*
+ * json_string - Return a string value, or NULL
+ */
+const char *json_string(json_t *v)
+{
+    if (v == NULL || v->type != JSON_STRING)
+	return NULL;
+    return v->str;
+}
@@ -0,0 +1,42 @@
+/*
+ * json.h - A small JSON reader, enough to load the results that
+ *     mdriver writes with --format=json
+ */
+#ifndef __JSON_H_
+#define __JSON_H_
+
+#include <stddef.h>
+
+/* JSON value types */
+typedef enum {
+    JSON_NULL, JSON_BOOL, JSON_NUMBER, JSON_STRING, JSON_ARRAY, JSON_OBJECT
+} json_type_t;
+
+/* One parsed value. Arrays and objects keep their members in a list */
+typedef struct json_t {
+    json_type_t type;
+    char *key;              /* member name, when inside an object */
+    double num;             /* JSON_NUMBER, and 0/1 for JSON_BOOL */
+    char *str;              /* JSON_STRING */
+    struct json_t *child;   /* first member of an array or object */
+    struct json_t *next;    /* next member of the enclosing container */
+} json_t;
+
+/* Parse a whole file. On failure, return NULL with a message in err */
+json_t *json_load(const char *path, char *err, size_t errlen);
+
+/* Parse a NUL-terminated string. On failure, as for json_load */
+json_t *json_parse(const char *text, char *err, size_t errlen);
+
+/* Free a value returned by json_parse or json_load */
+void json_free(json_t *v);
+
+/* Accessors. Each accepts NULL and returns NULL, 0 or dflt on a miss */
+json_t *json_get(json_t *obj, const char *key);
+json_t *json_path(json_t *obj, const char *path);  /* "a.b.c" */
+json_t *json_at(json_t *arr, int i);
+int json_len(json_t *arr);
+double json_num(json_t *v, double dflt);
+const char *json_string(json_t *v);
+
+#endif /* __JSON_H_ */
@@ -0,0 +1,119 @@
+/*
+ * lathist.c - Log-bucketed latency histograms
+ *
+ * A value v below 2*LAT_SUB_COUNT is stored exactly. Larger values
+ * are stored in the octave of their most significant bit, in one of
+ * LAT_SUB_COUNT equal-width sub-buckets of that octave.
+ */
+#include <string.h>
+#include "lathist.h"
+
+const char *lat_op_names[LAT_NOPS] = { "malloc", "free", "realloc" };
+
+/* number of timer pairs sampled by lat_overhead */
+#define OVERHEAD_SAMPLES 1000
+
+/*
+ * bucket_index - Map a value to its histogram bucket
+ */
+static int bucket_index(uint64_t v)
+{
+    int msb, shift;
+
+    if (v < 2 * LAT_SUB_COUNT)
+	return (int)v;
+    msb = 63 - __builtin_clzll(v);
+    shift = msb - LAT_SUB_BITS;
+    return (shift + 1) * LAT_SUB_COUNT + (int)((v >> shift) - LAT_SUB_COUNT);
+}
+
+/*
+ * bucket_high - Return the largest value that maps to bucket i
+ */
+static uint64_t bucket_high(int i)
+{
+    int shift;
+    uint64_t top;
+
+    if (i < 2 * LAT_SUB_COUNT)
+	return (uint64_t)i;
+    shift = i / LAT_SUB_COUNT - 1;
+    top = LAT_SUB_COUNT + i % LAT_SUB_COUNT;
+    return ((top + 1) << shift) - 1;
+}
+
+/*
+ * lathist_clear - Empty a histogram
+ */
+void lathist_clear(lathist_t *h)
+{
+    memset(h, 0, sizeof(*h));
+}
+
+/*
+ * lathist_record - Add one value (in ns) to a histogram
+ */
+void lathist_record(lathist_t *h, uint64_t ns)
+{
+    if (ns > h->max)
+	h->max = ns;
+    if (ns >= (1ull << LAT_MAX_BITS))
+	ns = (1ull << LAT_MAX_BITS) - 1;
+    h->counts[bucket_index(ns)]++;
+    h->total++;
+}
+
+/*
+ * lathist_percentile - Return the value below which pct percent of the
+ *     recorded values fall, rounded up to its bucket's upper bound
+ */
+uint64_t lathist_percentile(const lathist_t *h, double pct)
+{
+    uint64_t rank, seen = 0, high;
+    int i;
+
+    if (h->total == 0)
+	return 0;
+    rank = (uint64_t)(pct / 100.0 * h->total + 0.5);
+    if (rank < 1)
+	rank = 1;
+    for (i = 0; i < LAT_BUCKETS; i++) {
+	seen += h->counts[i];
+	if (seen >= rank) {
+	    high = bucket_high(i);
+	    return (high < h->max) ? high : h->max;
+	}
+    }
+    return h->max;
+}
+
+/*
+ * lathist_summarize - Fill in the summary percentiles for a histogram
+ */
+void lathist_summarize(const lathist_t *h, latsum_t *sum)
+{
+    sum->count = (double)h->total;
+    sum->p50 = (double)lathist_percentile(h, 50.0);
+    sum->p99 = (double)lathist_percentile(h, 99.0);
+    sum->p999 = (double)lathist_percentile(h, 99.9);
+    sum->max = (double)h->max;
+}
+
+/*
+ * lat_overhead - Time empty back-to-back lat_now() pairs and return
+ *     the smallest observed gap. This is the fixed cost included in
+ *     every timed operation, and is subtracted before recording.
+ */
+uint64_t lat_overhead(void)
+{
+    uint64_t best = UINT64_MAX, start, delta;
+    int i;
+
+    for (i = 0; i < OVERHEAD_SAMPLES; i++) {
+	start = lat_now();
+	delta = lat_now() - start;
+	if (delta < best)
+	    best = delta;
+    }
+    return best;
+}
@@ -0,0 +1,60 @@
+/*
+ * lathist.h - Log-bucketed latency histograms for timing individual
+ *     allocator operations.
+ *
+ * Values are recorded in nanoseconds.  Each power of two is split into
+ * LAT_SUB_COUNT linear sub-buckets (the HDR histogram scheme), so any
+ * reported percentile is within 1/LAT_SUB_COUNT of the true value.
+ */
+#ifndef __LATHIST_H_
+#define __LATHIST_H_
+
+#include <stdint.h>
+#include <time.h>
+
+/* The operation types that get their own histogram */
+enum { LAT_MALLOC, LAT_FREE, LAT_REALLOC, LAT_NOPS };
+
+#define LAT_SUB_BITS   4                   /* log2 of sub-buckets per octave */
+#define LAT_SUB_COUNT  (1 << LAT_SUB_BITS)
+#define LAT_MAX_BITS   40                  /* larger values are clamped */
+#define LAT_BUCKETS    ((LAT_MAX_BITS - LAT_SUB_BITS + 1) * LAT_SUB_COUNT)
+
+typedef struct {
+    uint64_t counts[LAT_BUCKETS];
+    uint64_t total;   /* number of recorded values */
+    uint64_t max;     /* largest recorded value (exact) */
+} lathist_t;
+
+/* Summarizes one histogram; all times are in nanoseconds */
+typedef struct {
+    double count;
+    double p50;
+    double p99;
+    double p999;
+    double max;
+} latsum_t;
+
+/* Names of the LAT_xxx operation types, for printing */
+extern const char *lat_op_names[LAT_NOPS];
+
+void lathist_clear(lathist_t *h);
+void lathist_record(lathist_t *h, uint64_t ns);
+uint64_t lathist_percentile(const lathist_t *h, double pct);
+void lathist_summarize(const lathist_t *h, latsum_t *sum);
+
+/* Estimate the cost of a back-to-back pair of lat_now() calls */
+uint64_t lat_overhead(void);
+
+/*
+ * lat_now - Read the monotonic clock in nanoseconds. This is inline
+ *     because it sits between every pair of timed allocator calls.
+ */
+static inline uint64_t lat_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+#endif /* __LATHIST_H_ */
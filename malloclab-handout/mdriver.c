@@ -7,6 +7,7 @@
  * Copyright (c) 2002, R. Bryant and D. O'Hallaron, All rights reserved.
  * May not be used, modified, or copied without permission.
  */
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
@@ -17,11 +18,26 @@
 #include <math.h>
 #include <inttypes.h>
 #include <time.h>
+#include <getopt.h>
+#include <sched.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <sys/personality.h>
 
 #include "mm.h"
 #include "memlib.h"
 #include "pagemap.h"
 #include "fsecs.h"
+#include "lathist.h"
+#include "results.h"
+#include "baseline.h"
+#include "perfctr.h"
+#include "calib.h"
+#include "backend.h"
+#include "trace.h"
+#include "idmap.h"
+#include "evlog.h"
 #include "config.h"
 
 /**********************
@@ -32,6 +48,8 @@
 #define MAXLINE     1024 /* max string size */
 #define HDRLINES       4 /* number of header lines in a trace file */
 #define LINENUM(i) (i+5) /* cnvt trace request nums to linenums (origin 1) */
+#define MAXBACKENDS   16 /* max number of backends besides mm */
+#define MAXJOBS       64 /* max number of worker processes (-j) */
 
 /* Returns true if p is ALIGNMENT-byte aligned */
 #define IS_ALIGNED(p)  ((((uintptr_t)(p)) % ALIGNMENT) == 0)
@@ -40,31 +58,16 @@
  * The key compound data types 
  *****************************/
 
-/* Records the extent of each block's payload */
+/* Records the extent of each block's payload, as a node of a treap
+   ordered by address */
 typedef struct range_t {
     char *lo;              /* low payload address */
     char *hi;              /* high payload address */
-    struct range_t *next;  /* next list element */
+    struct range_t *left;  /* ranges below lo... */
+    struct range_t *right; /* ... and above it */
+    unsigned prio;         /* heap-ordered random priority */
 } range_t;
 
-/* Characterizes a single trace operation (allocator request) */
-typedef struct {
-    enum {ALLOC, FREE, REALLOC} type; /* type of request */
-    int index;                        /* index for free() to use later */
-    int size;                         /* byte size of alloc/realloc request */
-} traceop_t;
-
-/* Holds the information for one trace file*/
-typedef struct {
-    int sugg_heapsize;   /* suggested heap size (unused) */
-    int num_ids;         /* number of alloc/realloc ids */
-    int num_ops;         /* number of distinct requests */
-    int weight;          /* weight for this trace (unused) */
-    traceop_t *ops;      /* array of requests */
-    char **blocks;       /* array of ptrs returned by malloc/realloc... */
-    size_t *block_sizes; /* ... and a corresponding array of payload sizes */
-} trace_t;
-
 /* 
  * Holds the params to the xxx_speed functions, which are timed by fcyc. 
  * This struct is necessary because fcyc accepts only a pointer array
@@ -73,22 +76,25 @@ typedef struct {
 typedef struct {
     trace_t *trace;  
     range_t *ranges;
+    backend_t *backend;
+    char *tracefile;     /* name of the trace, when it is streamed */
 } speed_t;
 
-/* Summarizes the important stats for some malloc function on some trace */
+/* The running utilization of a replay, updated after every op */
 typedef struct {
-    /* defined for both libc malloc and student malloc package (mm.c) */
-    double ops;      /* number of ops (malloc/free/realloc) in the trace */
-    int valid;       /* was the trace processed correctly by the allocator? */
-    double secs;     /* number of secs needed to run the trace */
-
-    /* defined only for the student malloc package */
-    double util;     /* overall space utilization for this trace (always 0 for libc) */
-
-    double inst_util;     /* instanteous space utilization for this trace (always 0 for libc) */
-
-    /* Note: secs and util are only defined if valid is true */
-} stats_t; 
+    size_t max_total_size;   /* peak bytes of live payload */
+    size_t max_heap_size;    /* peak heap size */
+    double accum_ratio_frac; /* product of the per-op ratios of live */
+    double accum_ratio_exp;  /*   payload to heap, as frac * 2^exp */
+    int nops;
+} util_acc_t;
+
+/* What a worker process (-j) sends back for its trace */
+typedef struct {
+    int tracenum;
+    int errors;          /* errors it reported */
+    stats_t stats;
+} job_result_t;
 
 /********************
  * Global variables
@@ -105,33 +111,149 @@ static char *default_tracefiles[] = {
     DEFAULT_TRACEFILES, NULL
 };
 
+/* Timing parameters; used in place of fsecs() when rigorous is set */
+static int rigorous = 0;
+static ftimer_params_t timing_params = {
+    STATS_WARMUP, STATS_MIN_REPS, STATS_MAX_REPS, STATS_TARGET_CI
+};
+
+/* Codes for the options that only have a long form */
+enum {
+    OPT_RIGOROUS = 256, OPT_CPU, OPT_WARMUP, OPT_MIN_REPS, OPT_MAX_REPS, 
+    OPT_CI, OPT_CLOCK, OPT_FORMAT, OPT_OUT, OPT_BASELINE, OPT_THRESHOLD,
+    OPT_LAT_THRESHOLD, OPT_COUNTERS, OPT_CALIBRATE, OPT_RECALIBRATE,
+    OPT_BACKEND, OPT_STREAM, OPT_SERIAL_SPEED, OPT_FUSED, OPT_SERIES,
+    OPT_FRAG, OPT_LAYOUT, OPT_LAYOUT_BASE
+};
+
+static struct option long_options[] = {
+    {"rigorous", no_argument,       NULL, OPT_RIGOROUS},
+    {"cpu",      required_argument, NULL, OPT_CPU},
+    {"warmup",   required_argument, NULL, OPT_WARMUP},
+    {"min-reps", required_argument, NULL, OPT_MIN_REPS},
+    {"max-reps", required_argument, NULL, OPT_MAX_REPS},
+    {"ci",       required_argument, NULL, OPT_CI},
+    {"clock",    required_argument, NULL, OPT_CLOCK},
+    {"format",   required_argument, NULL, OPT_FORMAT},
+    {"out",      required_argument, NULL, OPT_OUT},
+    {"baseline", required_argument, NULL, OPT_BASELINE},
+    {"threshold", required_argument, NULL, OPT_THRESHOLD},
+    {"lat-threshold", required_argument, NULL, OPT_LAT_THRESHOLD},
+    {"counters", no_argument,       NULL, OPT_COUNTERS},
+    {"calibrate", no_argument,      NULL, OPT_CALIBRATE},
+    {"recalibrate", no_argument,    NULL, OPT_RECALIBRATE},
+    {"backend",  required_argument, NULL, OPT_BACKEND},
+    {"stream",   no_argument,       NULL, OPT_STREAM},
+    {"serial-speed", no_argument,   NULL, OPT_SERIAL_SPEED},
+    {"fused",    no_argument,       NULL, OPT_FUSED},
+    {"series",   required_argument, NULL, OPT_SERIES},
+    {"frag",     required_argument, NULL, OPT_FRAG},
+    {"layout",   optional_argument, NULL, OPT_LAYOUT},
+    {"layout-base", required_argument, NULL, OPT_LAYOUT_BASE},
+    {NULL, 0, NULL, 0}
+};
+
+/* Streaming replay (--stream) reads each trace in windows of ops, and
+   keeps only the live blocks, in this map, instead of loading it all */
+static int stream = 0;
+static idmap_t live;
+
+/* With --fused, validity and utilization are checked in one replay */
+static int fused = 0;
+
+/* With --series, the live bytes, heap size and free bytes during each
+   utilization replay are written to series as CSV, SERIES_POINTS or
+   fewer per trace */
+static FILE *series = NULL;
+static char **series_traces;  /* names of the traces, by number */
+
+/* With --frag, the utilization replays take a snapshot of the free
+   blocks every frag_interval ops and at each new peak of live bytes,
+   summarized in frag_cur, the stats of the trace being replayed */
+static int frag_interval = 0;
+static fragsum_t *frag_cur = NULL;
+
+/* Parallel evaluation (-j) runs up to jobs traces at once, each in a
+   worker process pinned to one of the cpus. With --serial-speed, the
+   workers pass a token through speed_lock so that only one of them is
+   timing a trace at any moment */
+static int jobs = 1;
+static int cpus[MAXJOBS];
+static int ncpus;
+static int speed_lock[2] = {-1, -1};
+
+/* Per-op latency histograms, refilled for each trace when -L is given */
+static lathist_t lat_hists[LAT_NOPS];
+
+/* Number of timed replays since time_speed started, which memlib's
+   system call counts are divided by */
+static int speed_runs;
+static uint64_t lat_ovhd;  /* timer overhead subtracted from each sample */
+
 
 /********************* 
  * Function prototypes 
  *********************/
 
-/* these functions manipulate range lists */
+/* these functions manipulate range sets */
 static int add_range(range_t **ranges, char *lo, int size, 
-		     int tracenum, int opnum);
+		     int tracenum, int opnum, int mapped);
 static void remove_range(range_t **ranges, char *lo);
 static void clear_ranges(range_t **ranges);
 
-/* These functions read, allocate, and free storage for traces */
-static trace_t *read_trace(char *tracedir, char *filename);
-static void free_trace(trace_t *trace);
-
-/* Routines for evaluating the correctness and speed of libc malloc */
-static int eval_libc_valid(trace_t *trace, int tracenum);
-static void eval_libc_speed(void *ptr);
-
 /* Routines for evaluating correctnes, space utilization, and speed 
-   of the student's malloc package in mm.c */
-static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges);
-static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges, double *inst_ratio);
-static void eval_mm_speed(void *ptr);
+   of a malloc package: mm.c, libc, or one loaded with --backend */
+static int eval_valid(backend_t *b, trace_t *trace, int tracenum, 
+		      range_t **ranges);
+static void eval_util(backend_t *b, trace_t *trace, int tracenum, 
+		      stats_t *stats);
+static void eval_speed(void *ptr);
+static void eval_latency(backend_t *b, trace_t *trace, lathist_t *hists);
+static int eval_fused(backend_t *b, trace_t *trace, int tracenum,
+		      range_t **ranges, stats_t *stats);
+static int eval_stream_valid(backend_t *b, char *filename, int tracenum,
+			     range_t **ranges, stats_t *stats);
+static void util_init(util_acc_t *u);
+static void util_update(util_acc_t *u, size_t total_size, size_t heap_size);
+static void util_finish(util_acc_t *u, stats_t *stats);
+static void sample_heap(backend_t *b, int tracenum, int opnum, int nops,
+			size_t total_size, size_t heap_size);
+static void eval_stream_speed(void *ptr);
+static void eval_trace(backend_t *b, char *tracefile, int tracenum,
+		       range_t **ranges, stats_t *stats, int latency);
+static void eval_backend(backend_t *b, char **tracefiles, int n, 
+			 stats_t *stats, int latency);
+static void eval_parallel(backend_t *b, char **tracefiles, int n, 
+			  stats_t *stats, int latency);
+static pid_t start_worker(backend_t *b, char **tracefiles, int tracenum,
+			  stats_t *stats, int latency, int cpu, FILE *rows,
+			  int *fd);
+static void copy_rows(FILE *rows);
+
+/* Replays a trace LATENCY_RUNS times, summarizing the op latencies */
+static void measure_latency(backend_t *b, trace_t *trace, latsum_t *lat);
+
+/* Times one of the xxx_speed routines, filling in secs and timing */
+static void time_speed(fsecs_test_funct f, speed_t *params, stats_t *stats);
 
 /* Various helper routines */
+static void pin_cpu(int cpu);
+static void no_aslr(char **argv);
+static void init_jobs(int serial_speed);
+static void speed_acquire(void);
+static void speed_release(void);
 static void printresults(int n, stats_t *stats);
+static void printcounts(stats_t *s);
+static void printsearch(int n, stats_t *stats);
+static void printtiming(int n, stats_t *stats);
+static void printphases(int n, stats_t *stats);
+static void printsyscalls(int n, stats_t *stats);
+static void printmmphases(int n, stats_t *stats);
+static void printcounters(int n, stats_t *stats);
+static void printlatency(int n, stats_t *stats);
+static void printfrag(int n, stats_t *stats);
+static void printratios(int n, stats_t *stats, stats_t *ref);
+static void printcomparison(results_t *res, int nres);
 static void usage(void);
 static void unix_error(char *msg);
 static void malloc_error(int tracenum, int opnum, char *msg);
@@ -142,28 +264,54 @@ static void app_error(char *msg);
  **************/
 int main(int argc, char **argv)
 {
-    int i;
-    char c;
+    int i, j;
+    int c;
     char **tracefiles = NULL;  /* null-terminated array of trace file names */
     int num_tracefiles = 0;    /* the number of traces in that array */
-    trace_t *trace = NULL;     /* stores a single trace file in memory */
-    range_t *ranges = NULL;    /* keeps track of block extents for one trace */
+    backend_t *others[MAXBACKENDS]; /* backends to compare with mm */
+    int num_others = 0;        /* the number of them */
+    stats_t *other_stats[MAXBACKENDS]; /* their stats for each trace */
     stats_t *libc_stats = NULL;/* libc stats for each trace */
     stats_t *mm_stats = NULL;  /* mm (i.e. student) stats for each trace */
-    speed_t speed_params;      /* input parameters to the xx_speed routines */ 
+    backend_t *b;
 
     int run_libc = 0;    /* If set, run libc malloc (set by -l) */
     int autograder = 0;  /* If set, emit summary info for autograder (-g) */
+    int latency = 0;     /* If set, measure per-op latency (set by -L) */
+    int cpu = -1;        /* If not -1, pin to this CPU (set by --cpu) */
+    int counters = 0;    /* If set, count perf events (set by --counters) */
+    int serial_speed = 0;/* If set, time one trace at a time (with -j) */
+    int calibrate = 0;   /* If set, measure libc on this host for the
+			    perf index (1 = --calibrate, 2 = --recalibrate) */
+    char *calibfile = NULL; /* ... caching the result here */
+    int layout = 0;      /* If set, fix the addresses of mm's pages */
+    unsigned long layout_base = LAYOUT_BASE; /* ... from here on */
+    unsigned layout_seed = LAYOUT_SEED; /* ... and seed the noise placement */
+    stats_t *ref_stats = NULL; /* libc stats that the index is based on */
+    double thru_ref = AVG_LIBC_THRUPUT; /* libc ops/sec for the index */
+    int clock = FTIMER_RAW; /* Clock for rigorous mode (set by --clock) */
+    int format = 0;      /* If set, FORMAT_xxx of results (set by --format) */
+    char *outfile = NULL;/* Where to write them (set by --out) */
+    FILE *out = NULL;    /* ... once opened */
+    char *baseline = NULL; /* Saved results to compare to (--baseline) */
+    baseline_opts_t baseline_opts = {
+	BASELINE_THRESHOLD / 100.0, BASELINE_LAT_THRESHOLD / 100.0
+    };
+    int regressions = 0;
+    results_t results[MAXBACKENDS+1]; /* results of every backend */
+    int nresults = 0;
+    runinfo_t runinfo;
 
     /* temporaries used to compute the performance index */
     double secs, ops, util, inst_util, avg_mm_inst_util, avg_mm_util, avg_mm_throughput;
-    double p1, p1i, p2, perfindex;
+    double p1 = 0, p1i = 0, p2 = 0, perfindex;
     int numcorrect;
     
     /* 
      * Read and interpret the command line arguments 
      */
-    while ((c = getopt(argc, argv, "f:t:hvVgal")) != EOF) {
+    while ((c = getopt_long(argc, argv, "f:t:j:hvVgalL", 
+			    long_options, NULL)) != EOF) {
         switch (c) {
 	case 'g': /* Generate summary info for the autograder */
 	    autograder = 1;
@@ -183,9 +331,19 @@ int main(int argc, char **argv)
 	    if (tracedir[strlen(tracedir)-1] != '/') 
 		strcat(tracedir, "/"); /* path always ends with "/" */
 	    break;
+        case 'j': /* Evaluate traces in parallel worker processes */
+	    jobs = atoi(optarg);
+	    if (jobs < 1 || jobs > MAXJOBS) {
+		sprintf(msg, "-j must be between 1 and %d", MAXJOBS);
+		app_error(msg);
+	    }
+	    break;
         case 'l': /* Run libc malloc */
             run_libc = 1;
             break;
+        case 'L': /* Measure the latency of each individual op */
+            latency = 1;
+            break;
         case 'v': /* Print per-trace performance breakdown */
             verbose = 1;
             break;
@@ -195,12 +353,136 @@ int main(int argc, char **argv)
         case 'h': /* Print this message */
 	    usage();
             exit(0);
+	case OPT_RIGOROUS: /* Repeat timings until confidence is high */
+	    rigorous = 1;
+	    break;
+	case OPT_CPU: /* Pin the driver to one CPU */
+	    cpu = atoi(optarg);
+	    break;
+	case OPT_WARMUP: /* Untimed runs before sampling */
+	    timing_params.warmup = atoi(optarg);
+	    break;
+	case OPT_MIN_REPS: /* Fewest timed samples per trace */
+	    timing_params.min_reps = atoi(optarg);
+	    break;
+	case OPT_MAX_REPS: /* Most timed samples per trace */
+	    timing_params.max_reps = atoi(optarg);
+	    break;
+	case OPT_CI: /* Target CI half-width, in percent of the mean */
+	    timing_params.target_ci = atof(optarg) / 100.0;
+	    break;
+	case OPT_CLOCK: /* Clock used in rigorous mode */
+	    if (strcmp(optarg, "raw") == 0)
+		clock = FTIMER_RAW;
+	    else if (strcmp(optarg, "tsc") == 0)
+		clock = FTIMER_TSC;
+	    else {
+		usage();
+		exit(1);
+	    }
+	    break;
+	case OPT_FORMAT: /* Write machine-readable results */
+	    if (strcmp(optarg, "json") == 0)
+		format = FORMAT_JSON;
+	    else if (strcmp(optarg, "csv") == 0)
+		format = FORMAT_CSV;
+	    else {
+		usage();
+		exit(1);
+	    }
+	    break;
+	case OPT_OUT: /* File for machine-readable results */
+	    outfile = optarg;
+	    break;
+	case OPT_BASELINE: /* Compare against saved JSON results */
+	    baseline = optarg;
+	    break;
+	case OPT_THRESHOLD: /* Allowed throughput/util loss, in percent */
+	    baseline_opts.threshold = atof(optarg) / 100.0;
+	    break;
+	case OPT_LAT_THRESHOLD: /* Allowed p99 latency growth, in percent */
+	    baseline_opts.lat_threshold = atof(optarg) / 100.0;
+	    break;
+	case OPT_COUNTERS: /* Count hardware/software events per op */
+	    counters = 1;
+	    break;
+	case OPT_BACKEND: /* Compare with another malloc package */
+	    if ((b = backend_get(optarg, msg, MAXLINE)) == NULL)
+		app_error(msg);
+	    if (num_others == MAXBACKENDS)
+		app_error("too many backends");
+	    others[num_others++] = b;
+	    break;
+	case OPT_STREAM: /* Stream traces instead of loading them */
+	    stream = 1;
+	    break;
+	case OPT_SERIAL_SPEED: /* With -j, time the traces one at a time */
+	    serial_speed = 1;
+	    break;
+	case OPT_FUSED: /* Check validity and utilization in one replay */
+	    fused = 1;
+	    break;
+	case OPT_SERIES: /* Write the heap time series of each trace */
+	    if ((series = fopen(optarg, "w")) == NULL) {
+		sprintf(msg, "Could not open %s", optarg);
+		unix_error(msg);
+	    }
+	    fprintf(series, "backend,trace,op,live_bytes,mapped_bytes,"
+		    "free_bytes\n");
+	    break;
+	case OPT_FRAG: /* Snapshot the free blocks every n ops */
+	    if ((frag_interval = atoi(optarg)) < 1)
+		app_error("--frag needs an interval of at least 1 op");
+	    break;
+	case OPT_LAYOUT: /* Map mm's pages at the same addresses every run */
+	    layout = 1;
+	    if (optarg)
+		layout_seed = strtoul(optarg, NULL, 0);
+	    break;
+	case OPT_LAYOUT_BASE: /* ... starting at this address */
+	    layout_base = strtoul(optarg, NULL, 0);
+	    if (layout_base & (mem_pagesize() - 1))
+		app_error("--layout-base must be page-aligned");
+	    break;
+	case OPT_CALIBRATE: /* Index against libc on this host */
+	    if (calibrate == 0)
+		calibrate = 1;
+	    break;
+	case OPT_RECALIBRATE: /* ... ignoring any cached measurement */
+	    calibrate = 2;
+	    break;
         default:
 	    usage();
             exit(1);
         }
     }
+
+    /* A fixed heap layout is only reproducible if the driver's own
+       memory is laid out the same way each time, too */
+    if (layout)
+	no_aslr(argv);
 	
+    /*
+     * Open the machine-readable output. If it goes to stdout, the usual
+     * human-readable report is sent to stderr so it doesn't get mixed in.
+     */
+    if (outfile != NULL && format == 0)
+	app_error("--out requires --format");
+    if (format) {
+	if (outfile == NULL || strcmp(outfile, "-") == 0) {
+	    int fd = dup(STDOUT_FILENO);
+	    if (fd < 0 || (out = fdopen(fd, "w")) == NULL)
+		unix_error("could not duplicate stdout");
+	    fflush(stdout);
+	    if (dup2(STDERR_FILENO, STDOUT_FILENO) < 0)
+		unix_error("could not redirect stdout");
+	}
+	else if ((out = fopen(outfile, "w")) == NULL) {
+	    sprintf(msg, "Could not open %s", outfile);
+	    unix_error(msg);
+	}
+    }
+
     /* 
      * If no -f command line arg, then use the entire set of tracefiles 
      * defined in default_traces[]
@@ -210,43 +492,132 @@ int main(int argc, char **argv)
         num_tracefiles = sizeof(default_tracefiles) / sizeof(char *) - 1;
 	printf("Using default tracefiles in %s\n", tracedir);
     }
+    series_traces = tracefiles;
+
+    /* -l puts libc malloc first, unless --backend=libc already named it */
+    if (run_libc) {
+	for (j=0; j < num_others && others[j] != &libc_backend; j++)
+	    ;
+	if (j == num_others) {
+	    if (num_others == MAXBACKENDS)
+		app_error("too many backends");
+	    memmove(&others[1], &others[0], num_others * sizeof(backend_t *));
+	    others[0] = &libc_backend;
+	    num_others++;
+	}
+    }
+
+    if (timing_params.min_reps < 2 || 
+	timing_params.max_reps < timing_params.min_reps)
+	app_error("need 2 <= --min-reps <= --max-reps");
+
+    if (cpu >= 0)
+	pin_cpu(cpu);
+    if (jobs > 1)
+	init_jobs(serial_speed);
+
+    if (counters && perfctr_init() == 0)
+	printf("Warning: no event counters are available\n");
 
     /* Initialize the timing package */
-    init_fsecs();
+    if (rigorous) {
+	if (ftimer_set_clock(clock) < 0)
+	    app_error("the invariant TSC clock is not available on this CPU");
+	if (verbose)
+	    printf("Measuring performance with %s until the 95%% CI is "
+		   "within %g%% of the mean.\n",
+		   (clock == FTIMER_TSC) ? "the invariant TSC" 
+		   : "clock_gettime(CLOCK_MONOTONIC_RAW)",
+		   timing_params.target_ci * 100.0);
+    }
+    else
+	init_fsecs();
+    if (latency)
+	lat_ovhd = lat_overhead();
+    if (stream) {
+	if (latency)
+	    printf("Warning: -L is ignored with --stream\n");
+	latency = 0;
+	idmap_init(&live);
+    }
 
     /*
-     * Optionally run and evaluate the libc malloc package 
+     * Optionally run and evaluate libc malloc and any other backends
      */
-    if (run_libc) {
+    for (j=0; j < num_others; j++) {
 	if (verbose > 1)
-	    printf("\nTesting libc malloc\n");
+	    printf("\nTesting %s malloc\n", others[j]->name);
 	
-	/* Allocate libc stats array, with one stats_t struct per tracefile */
-	libc_stats = (stats_t *)calloc(num_tracefiles, sizeof(stats_t));
-	if (libc_stats == NULL)
-	    unix_error("libc_stats calloc in main failed");
+	/* Allocate a stats array, with one stats_t struct per tracefile */
+	other_stats[j] = (stats_t *)calloc(num_tracefiles, sizeof(stats_t));
+	if (other_stats[j] == NULL)
+	    unix_error("other_stats calloc in main failed");
+	if (others[j] == &libc_backend)
+	    libc_stats = other_stats[j];
 	
-	/* Evaluate the libc malloc package using the K-best scheme */
-	for (i=0; i < num_tracefiles; i++) {
-	    trace = read_trace(tracedir, tracefiles[i]);
-	    libc_stats[i].ops = trace->num_ops;
-	    if (verbose > 1)
-		printf("Checking libc malloc for correctness, ");
-	    libc_stats[i].valid = eval_libc_valid(trace, i);
-	    if (libc_stats[i].valid) {
-		speed_params.trace = trace;
-		if (verbose > 1)
-		    printf("and performance.\n");
-		libc_stats[i].secs = fsecs(eval_libc_speed, &speed_params);
+	/* Evaluate the package using the K-best scheme */
+	eval_backend(others[j], tracefiles, num_tracefiles, other_stats[j], 
+		     latency);
+
+	/* Display the results in a compact table */
+	if (verbose) {
+	    printf("\nResults for %s malloc:\n", others[j]->name);
+	    printresults(num_tracefiles, other_stats[j]);
+	    if (rigorous)
+		printtiming(num_tracefiles, other_stats[j]);
+	}
+	if (latency) {
+	    printf("\nLatency for %s malloc (ns):\n", others[j]->name);
+	    printlatency(num_tracefiles, other_stats[j]);
+	}
+	if (counters) {
+	    printf("\nEvents per op for %s malloc:\n", others[j]->name);
+	    printcounters(num_tracefiles, other_stats[j]);
+	}
+	if (frag_interval && others[j]->heapinfo != NULL) {
+	    printf("\nFragmentation for %s malloc:\n", others[j]->name);
+	    printfrag(num_tracefiles, other_stats[j]);
+	}
+    }
+
+    /*
+     * Optionally measure the libc throughput that the performance index
+     * is based on, instead of using AVG_LIBC_THRUPUT. The measurement
+     * is cached for this host, traces and timer, so later runs only
+     * pay for it once.
+     */
+    if (calibrate) {
+	calibfile = calib_path(tracefiles, num_tracefiles, tracedir,
+			       !rigorous ? "fsecs" 
+			       : (clock == FTIMER_TSC) ? "tsc" : "raw");
+	if (libc_stats != NULL)
+	    ref_stats = libc_stats;
+	else {
+	    ref_stats = (stats_t *)calloc(num_tracefiles, sizeof(stats_t));
+	    if (ref_stats == NULL)
+		unix_error("ref_stats calloc in main failed");
+	}
+	if (libc_stats != NULL || calibrate == 2 ||
+	    !calib_load(calibfile, tracefiles, num_tracefiles, ref_stats)) {
+	    if (libc_stats == NULL) {
+		printf("Calibrating against libc malloc on this host...\n");
+		eval_backend(&libc_backend, tracefiles, num_tracefiles, 
+			     ref_stats, 0);
 	    }
-	    free_trace(trace);
+	    calib_save(calibfile, tracefiles, num_tracefiles, ref_stats);
 	}
+	else if (verbose)
+	    printf("Using the libc calibration in %s\n", calibfile);
 
-	/* Display the libc results in a compact table */
-	if (verbose) {
-	    printf("\nResults for libc malloc:\n");
-	    printresults(num_tracefiles, libc_stats);
+	secs = ops = 0;
+	for (i=0; i < num_tracefiles; i++) {
+	    if (ref_stats[i].valid) {
+		secs += ref_stats[i].secs;
+		ops += ref_stats[i].ops;
+	    }
 	}
+	if (secs > 0)
+	    thru_ref = ops/secs;
     }
 
     /*
@@ -262,31 +633,81 @@ int main(int argc, char **argv)
     
     /* Initialize the simulated memory system in memlib.c */
     mem_init(); 
+    if (layout)
+	mem_set_layout((void *)layout_base, LAYOUT_SIZE, layout_seed);
 
     /* Evaluate student's mm malloc package using the K-best scheme */
-    for (i=0; i < num_tracefiles; i++) {
-	trace = read_trace(tracedir, tracefiles[i]);
-	mm_stats[i].ops = trace->num_ops;
-	if (verbose > 1)
-	    printf("Checking mm_malloc for correctness, ");
-	mm_stats[i].valid = eval_mm_valid(trace, i, &ranges);
-	if (mm_stats[i].valid) {
-	    if (verbose > 1)
-		printf("efficiency, ");
-	    mm_stats[i].util = eval_mm_util(trace, i, &ranges, &mm_stats[i].inst_util);
-	    speed_params.trace = trace;
-	    speed_params.ranges = ranges;
-	    if (verbose > 1)
-		printf("and performance.\n");
-	    mm_stats[i].secs = fsecs(eval_mm_speed, &speed_params);
-	}
-	free_trace(trace);
-    }
+    eval_backend(&mm_backend, tracefiles, num_tracefiles, mm_stats, latency);
 
     /* Display the mm results in a compact table */
     if (verbose) {
 	printf("\nResults for mm malloc:\n");
 	printresults(num_tracefiles, mm_stats);
+	if (rigorous)
+	    printtiming(num_tracefiles, mm_stats);
+	printphases(num_tracefiles, mm_stats);
+	printf("\nMemory system calls per replay for mm malloc:\n");
+	printsyscalls(num_tracefiles, mm_stats);
+	printf("\n");
+	for (i = 0; i < num_tracefiles && !mm_stats[i].phased; i++)
+	    ;
+	if (i < num_tracefiles) {
+	    printf("Cycles in each phase of mm malloc:\n");
+	    printmmphases(num_tracefiles, mm_stats);
+	    printf("\n");
+	}
+	if (verbose > 1) {
+	    printf("Free list searches of mm malloc:\n");
+	    printsearch(num_tracefiles, mm_stats);
+	    printf("\n");
+	}
+    }
+    if (latency) {
+	printf("%sLatency for mm malloc (ns):\n", verbose ? "" : "\n");
+	printlatency(num_tracefiles, mm_stats);
+	printf("\n");
+    }
+    if (counters) {
+	printf("Events per op for mm malloc:\n");
+	printcounters(num_tracefiles, mm_stats);
+	printf("\n");
+    }
+    if (frag_interval) {
+	printf("Fragmentation for mm malloc:\n");
+	printfrag(num_tracefiles, mm_stats);
+	printf("\n");
+    }
+    if (ref_stats != NULL) {
+	printf("Speed relative to libc malloc:\n");
+	printratios(num_tracefiles, mm_stats, ref_stats);
+	printf("\n");
+    }
+
+    /*
+     * Collect the totals of every backend, with mm last, and compare
+     * them when there is more than one
+     */
+    for (j=0; j < num_others; j++) {
+	results[nresults].name = others[j]->name;
+	results[nresults].n = num_tracefiles;
+	results[nresults].stats = other_stats[j];
+	results[nresults].has_index = 0;
+	results[nresults].has_util = (others[j]->heapsize != NULL);
+	results[nresults].ref = NULL;
+	results_totals(&results[nresults++]);
+    }
+    results[nresults].name = "mm";
+    results[nresults].n = num_tracefiles;
+    results[nresults].stats = mm_stats;
+    results[nresults].has_index = 0;
+    results[nresults].has_util = 1;
+    results[nresults].ref = ref_stats;
+    results[nresults].thru_ref = thru_ref;
+    results[nresults].calibrated = (calibrate != 0);
+    results_totals(&results[nresults++]);
+    if (num_others > 0) {
+	printf("Comparison of malloc packages:\n");
+	printcomparison(results, nresults);
 	printf("\n");
     }
 
@@ -317,12 +738,12 @@ int main(int argc, char **argv)
 
 	p1 = UTIL_WEIGHT * avg_mm_util;
 	p1i = UTIL_I_WEIGHT * avg_mm_inst_util;
-	if (avg_mm_throughput > AVG_LIBC_THRUPUT) {
+	if (avg_mm_throughput > thru_ref) {
           p2 = (double)(1.0 - (UTIL_WEIGHT + UTIL_I_WEIGHT));
 	} 
 	else {
 	    p2 = ((double) (1.0 - (UTIL_WEIGHT + UTIL_I_WEIGHT))) * 
-		(avg_mm_throughput/AVG_LIBC_THRUPUT);
+		(avg_mm_throughput/thru_ref);
 	}
 	
 	perfindex = (p1 + p1i + p2)*100.0;
@@ -331,6 +752,9 @@ int main(int argc, char **argv)
 	       p1i*100, 
 	       p2*100,
 	       perfindex);
+	if (calibrate)
+	    printf("Throughput relative to libc malloc on this host "
+		   "(%.0f Kops/sec)\n", thru_ref/1e3);
 	
     }
     else { /* There were errors */
@@ -343,27 +767,146 @@ int main(int argc, char **argv)
 	printf("perfidx:%.0f\n", perfindex);
     }
 
-    exit(0);
+    /*
+     * Write the machine-readable results and compare with the baseline
+     */
+    if (format || baseline) {
+	results[nresults-1].has_index = (errors == 0);
+	if (errors == 0) {
+	    results[nresults-1].p_util = p1;
+	    results[nresults-1].p_inst_util = p1i;
+	    results[nresults-1].p_thru = p2;
+	    results[nresults-1].perfindex = perfindex;
+	}
+
+	runinfo.tracefiles = tracefiles;
+	runinfo.tracedir = tracedir;
+	runinfo.errors = errors;
+	runinfo.rigorous = rigorous;
+	runinfo.clock = clock;
+	runinfo.cpu = cpu;
+	runinfo.latency = latency;
+	runinfo.counters = counters;
+	runinfo.frag = (frag_interval > 0);
+	runinfo.layout = layout;
+	runinfo.layout_base = layout_base;
+	runinfo.layout_seed = layout_seed;
+	if (format) {
+	    write_results(out, format, &runinfo, results, nresults);
+	    fclose(out);
+	}
+	if (baseline) {
+	    regressions = compare_baseline(baseline, &baseline_opts, &runinfo,
+					   results, nresults);
+	    if (regressions < 0)
+		exit(1);
+	}
+    }
+
+    /* A regression against the baseline fails the run */
+    exit(regressions > 0 ? 2 : 0);
 }
 
 
 /*****************************************************************
- * The following routines manipulate the range list, which keeps 
+ * The following routines manipulate the range set, which keeps 
  * track of the extent of every allocated block payload. We use the 
- * range list to detect any overlapping allocated blocks.
+ * range set to detect any overlapping allocated blocks.
+ *
+ * The set is a treap ordered by payload address, so adding, finding
+ * and removing a range take O(log n) expected time. Since the ranges
+ * in the set never overlap, a new payload overlaps one of them iff it
+ * overlaps the nearest range below it or the nearest range above it.
+ * The records come from a pool rather than from malloc, which also
+ * keeps the checks out of libc's heap when libc is being tested.
  ****************************************************************/
 
+#define RANGE_CHUNK 4096   /* range records allocated at a time */
+
+static range_t *range_pool = NULL;  /* free records, linked by right */
+static unsigned range_seed = 1;     /* priority generator state */
+
+/* take a record from the pool, refilling it if it is empty */
+static range_t *range_alloc(void)
+{
+    range_t *p;
+    int i;
+
+    if (range_pool == NULL) {
+	if ((p = (range_t *)malloc(RANGE_CHUNK * sizeof(range_t))) == NULL)
+	    unix_error("malloc error in range_alloc");
+	for (i = 0; i < RANGE_CHUNK; i++) {
+	    p[i].right = range_pool;
+	    range_pool = &p[i];
+	}
+    }
+    p = range_pool;
+    range_pool = p->right;
+    return p;
+}
+
+/* return a record to the pool */
+static void range_free(range_t *p)
+{
+    p->right = range_pool;
+    range_pool = p;
+}
+
+/* insert node into the treap rooted at *root */
+static void range_insert(range_t **root, range_t *node)
+{
+    range_t *t = *root;
+
+    if (t == NULL) {
+	*root = node;
+	return;
+    }
+    if (node->lo < t->lo) {
+	range_insert(&t->left, node);
+	if (t->left->prio > t->prio) {  /* rotate right */
+	    *root = t->left;
+	    t->left = (*root)->right;
+	    (*root)->right = t;
+	}
+    }
+    else {
+	range_insert(&t->right, node);
+	if (t->right->prio > t->prio) { /* rotate left */
+	    *root = t->right;
+	    t->right = (*root)->left;
+	    (*root)->left = t;
+	}
+    }
+}
+
+/* join two treaps, where every range in a is below every range in b */
+static range_t *range_merge(range_t *a, range_t *b)
+{
+    if (a == NULL)
+	return b;
+    if (b == NULL)
+	return a;
+    if (a->prio > b->prio) {
+	a->right = range_merge(a->right, b);
+	return a;
+    }
+    b->left = range_merge(a, b->left);
+    return b;
+}
+
 /*
  * add_range - As directed by request opnum in trace tracenum,
  *     we've just called the student's mm_malloc to allocate a block of 
  *     size bytes at addr lo. After checking the block for correctness,
- *     we create a range struct for this block and add it to the range list. 
+ *     we create a range struct for this block and add it to the range set. 
+ *     The pages are only checked when mapped is set, since other
+ *     backends don't get their memory from memlib.
  */
 static int add_range(range_t **ranges, char *lo, int size, 
-		     int tracenum, int opnum)
+		     int tracenum, int opnum, int mapped)
 {
     char *hi = lo + size - 1;
-    range_t *p;
+    range_t *p, *below, *above, *overlap;
     char msg[MAXLINE];
     size_t page_size = mem_pagesize(), i;
 
@@ -378,7 +921,7 @@ static int add_range(range_t **ranges, char *lo, int size,
     }
     
     /* The payload must lie on a mapped page */
-    for (i = 0; i < size; i += page_size) {
+    for (i = 0; mapped && i < size; i += page_size) {
       if (!pagemap_is_mapped(lo+i)) {
 	sprintf(msg, "Payload (%p:%p) includes an unmapped page",
 		lo, hi);
@@ -386,34 +929,51 @@ static int add_range(range_t **ranges, char *lo, int size,
         return 0;
       }
     }
-    if (!pagemap_is_mapped(lo+size-1)) {
+    if (mapped && !pagemap_is_mapped(lo+size-1)) {
       sprintf(msg, "Payload (%p:%p) ends at an unmapped page",
               lo, hi);
       malloc_error(tracenum, opnum, msg);
       return 0;
     }
 
-    /* The payload must not overlap any other payloads */
-    for (p = *ranges;  p != NULL;  p = p->next) {
-        if ((lo >= p->lo && lo <= p-> hi) ||
-            (hi >= p->lo && hi <= p->hi)) {
-	    sprintf(msg, "Payload (%p:%p) overlaps another payload (%p:%p)\n",
-		    lo, hi, p->lo, p->hi);
-	    malloc_error(tracenum, opnum, msg);
-	    return 0;
-        }
+    /* The payload must not overlap the nearest payloads on either side */
+    below = above = NULL;
+    for (p = *ranges;  p != NULL; ) {
+	if (p->lo <= lo) {
+	    below = p;
+	    p = p->right;
+	}
+	else {
+	    above = p;
+	    p = p->left;
+	}
+    }
+    if ((p = below) != NULL && p->hi >= lo)
+	overlap = p;
+    else if ((p = above) != NULL && p->lo <= hi)
+	overlap = p;
+    else
+	overlap = NULL;
+    if (overlap != NULL) {
+	sprintf(msg, "Payload (%p:%p) overlaps another payload (%p:%p)\n",
+		lo, hi, overlap->lo, overlap->hi);
+	malloc_error(tracenum, opnum, msg);
+	return 0;
     }
 
     /* 
      * Everything looks OK, so remember the extent of this block 
-     * by creating a range struct and adding it the range list.
+     * by creating a range struct and adding it the range set.
      */
-    if ((p = (range_t *)malloc(sizeof(range_t))) == NULL)
-	unix_error("malloc error in add_range");
-    p->next = *ranges;
+    p = range_alloc();
     p->lo = lo;
     p->hi = hi;
-    *ranges = p;
+    p->left = p->right = NULL;
+    range_seed ^= range_seed << 13;  /* xorshift32 */
+    range_seed ^= range_seed >> 17;
+    range_seed ^= range_seed << 5;
+    p->prio = range_seed;
+    range_insert(ranges, p);
     return 1;
 }
 
@@ -423,15 +983,12 @@ static int add_range(range_t **ranges, char *lo, int size,
 static void remove_range(range_t **ranges, char *lo)
 {
     range_t *p;
-    range_t **prevpp = ranges;
 
-    for (p = *ranges;  p != NULL; p = p->next) {
-        if (p->lo == lo) {
-	    *prevpp = p->next;
-            free(p);
-            break;
-        }
-        prevpp = &(p->next);
+    while ((p = *ranges) != NULL && p->lo != lo)
+	ranges = (lo < p->lo) ? &p->left : &p->right;
+    if (p != NULL) {
+	*ranges = range_merge(p->left, p->right);
+	range_free(p);
     }
 }
 
@@ -440,132 +997,58 @@ static void remove_range(range_t **ranges, char *lo)
  */
 static void clear_ranges(range_t **ranges)
 {
-    range_t *p;
-    range_t *pnext;
+    range_t *p = *ranges;
 
-    for (p = *ranges;  p != NULL;  p = pnext) {
-        pnext = p->next;
-        free(p);
-    }
+    if (p == NULL)
+	return;
+    clear_ranges(&p->left);
+    clear_ranges(&p->right);
+    range_free(p);
     *ranges = NULL;
 }
 
 
-/**********************************************
- * The following routines manipulate tracefiles
- *********************************************/
+/**********************************************************************
+ * The following functions evaluate the correctness, space utilization,
+ * and throughput of an allocator backend: the mm package, libc malloc,
+ * or one loaded from a shared object. Apart from the validity check,
+ * a realloc is replayed as a malloc and free pair, so that every
+ * backend does the same work whether or not it has a realloc.
+ **********************************************************************/
 
 /*
- * read_trace - read a trace file and store it in memory
+ * check_stats - The running totals of a backend that keeps them must
+ *     agree with a walk of its heap
  */
-static trace_t *read_trace(char *tracedir, char *filename)
+static int check_stats(backend_t *b, int tracenum, int opnum)
 {
-    FILE *tracefile;
-    trace_t *trace;
-    char type[MAXLINE];
-    char path[MAXLINE];
-    unsigned index, size;
-    unsigned max_index = 0;
-    unsigned op_index;
-
-    if (verbose > 1)
-	printf("Reading tracefile: %s\n", filename);
-
-    /* Allocate the trace record */
-    if ((trace = (trace_t *) malloc(sizeof(trace_t))) == NULL)
-	unix_error("malloc 1 failed in read_trance");
-	
-    /* Read the trace file header */
-    strcpy(path, tracedir);
-    strcat(path, filename);
-    if ((tracefile = fopen(path, "r")) == NULL) {
-	sprintf(msg, "Could not open %s in read_trace", path);
-	unix_error(msg);
-    }
-    fscanf(tracefile, "%d", &(trace->sugg_heapsize)); /* not used */
-    fscanf(tracefile, "%d", &(trace->num_ids));     
-    fscanf(tracefile, "%d", &(trace->num_ops));     
-    fscanf(tracefile, "%d", &(trace->weight));        /* not used */
-    
-    /* We'll store each request line in the trace in this array */
-    if ((trace->ops = 
-	 (traceop_t *)malloc(trace->num_ops * sizeof(traceop_t))) == NULL)
-	unix_error("malloc 2 failed in read_trace");
-
-    /* We'll keep an array of pointers to the allocated blocks here... */
-    if ((trace->blocks = 
-	 (char **)malloc(trace->num_ids * sizeof(char *))) == NULL)
-	unix_error("malloc 3 failed in read_trace");
-
-    /* ... along with the corresponding byte sizes of each block */
-    if ((trace->block_sizes = 
-	 (size_t *)malloc(trace->num_ids * sizeof(size_t))) == NULL)
-	unix_error("malloc 4 failed in read_trace");
-    
-    /* read every request line in the trace file */
-    index = 0;
-    op_index = 0;
-    while (fscanf(tracefile, "%s", type) != EOF) {
-	switch(type[0]) {
-	case 'a':
-	    fscanf(tracefile, "%u %u", &index, &size);
-	    trace->ops[op_index].type = ALLOC;
-	    trace->ops[op_index].index = index;
-	    trace->ops[op_index].size = size;
-	    max_index = (index > max_index) ? index : max_index;
-	    break;
-	case 'r':
-	    fscanf(tracefile, "%u %u", &index, &size);
-	    trace->ops[op_index].type = REALLOC;
-	    trace->ops[op_index].index = index;
-	    trace->ops[op_index].size = size;
-	    max_index = (index > max_index) ? index : max_index;
-	    break;
-	case 'f':
-	    fscanf(tracefile, "%ud", &index);
-	    trace->ops[op_index].type = FREE;
-	    trace->ops[op_index].index = index;
-	    break;
-	default:
-	    printf("Bogus type character (%c) in tracefile %s\n", 
-		   type[0], path);
-	    exit(1);
-	}
-	op_index++;
-	
+    struct mm_stats stats;
+    mm_heapinfo_t info;
+
+    if (b->stats == NULL || b->heapinfo == NULL)
+	return 1;
+    b->stats(&stats);
+    b->heapinfo(&info);
+    if (stats.free_bytes != info.free_bytes ||
+	stats.free_blocks != info.free_blocks ||
+	stats.chunks != info.chunks ||
+	stats.mapped_bytes != info.chunk_bytes) {
+	malloc_error(tracenum, opnum, "mm_get_stats disagrees with the heap.");
+	return 0;
     }
-    fclose(tracefile);
-    assert(max_index == trace->num_ids - 1);
-    assert(trace->num_ops == op_index);
-    
-    return trace;
-}
-
-/*
- * free_trace - Free the trace record and the three arrays it points
- *              to, all of which were allocated in read_trace().
- */
-void free_trace(trace_t *trace)
-{
-    free(trace->ops);         /* free the three arrays... */
-    free(trace->blocks);      
-    free(trace->block_sizes);
-    free(trace);              /* and the trace record itself... */
+    return 1;
 }
 
-/**********************************************************************
- * The following functions evaluate the correctness, space utilization,
- * and throughput of the libc and mm malloc packages.
- **********************************************************************/
-
 /*
- * eval_mm_valid - Check the mm malloc package for correctness
+ * eval_valid - Check a malloc package for correctness
  */
-static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges) 
+static int eval_valid(backend_t *b, trace_t *trace, int tracenum, 
+		      range_t **ranges) 
 {
-    int i;
+    int i, j;
     int index;
     int size;
+    int oldsize;
     char *newp;
     char *oldp;
     char *p;
@@ -573,9 +1056,9 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
     /* Reset the heap and free any records in the range list */
     clear_ranges(ranges);
 
-    /* Call the mm package's init function */
-    if (mm_init() < 0) {
-	malloc_error(tracenum, 0, "mm_init failed.");
+    /* Call the package's init function */
+    if (b->init != NULL && b->init() < 0) {
+	malloc_error(tracenum, 0, "init failed.");
 	return 0;
     }
 
@@ -586,11 +1069,11 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
 
         switch (trace->ops[i].type) {
 
-        case ALLOC: /* mm_malloc */
+        case ALLOC: /* malloc */
 
-	    /* Call the student's malloc */
-	    if ((p = mm_malloc(size)) == NULL) {
-		malloc_error(tracenum, i, "mm_malloc failed.");
+	    /* Call the package's malloc */
+	    if ((p = b->malloc(size)) == NULL) {
+		malloc_error(tracenum, i, "malloc failed.");
 		return 0;
 	    }
 	    
@@ -599,7 +1082,7 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
 	     * to the range list if OK. The block must be  be aligned properly,
 	     * and must not overlap any currently allocated block. 
 	     */ 
-	    if (add_range(ranges, p, size, tracenum, i) == 0)
+	    if (add_range(ranges, p, size, tracenum, i, b->memlib) == 0)
 		return 0;
 	    
 	    /* ADDED: cgw
@@ -614,53 +1097,82 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
 	    trace->block_sizes[index] = size;
 	    break;
 
-        case REALLOC: /* mm_malloc + mm_free */
+        case REALLOC: /* realloc, or malloc + free */
 	    
-	    /* Call the student's realloc */
 	    oldp = trace->blocks[index];
-	    if ((newp = mm_malloc(size)) == NULL) {
-		malloc_error(tracenum, i, "mm_malloc failed.");
-		return 0;
+	    if (b->realloc != NULL) {
+		/* Call the package's realloc */
+		if ((newp = b->realloc(oldp, size)) == NULL) {
+		    malloc_error(tracenum, i, "realloc failed.");
+		    return 0;
+		}
+		remove_range(ranges, oldp);
+		if (add_range(ranges, newp, size, tracenum, i, b->memlib) == 0)
+		    return 0;
+
+		/* The old data must have been copied to the new block */
+		oldsize = trace->block_sizes[index];
+		if (size < oldsize)
+		    oldsize = size;
+		for (j = 0; j < oldsize; j++) {
+		    if (newp[j] != (index & 0xFF)) {
+			malloc_error(tracenum, i, "realloc did not preserve "
+				     "the data from the old block.");
+			return 0;
+		    }
+		}
+		memset(newp, index & 0xFF, size);
 	    }
-
-	    /* Remove the old region from the range list */
-	    remove_range(ranges, oldp);
+	    else {
+		if ((newp = b->malloc(size)) == NULL) {
+		    malloc_error(tracenum, i, "malloc failed.");
+		    return 0;
+		}
+
+		/* Remove the old region from the range list */
+		remove_range(ranges, oldp);
 	    
-	    /* Check new block for correctness and add it to range list */
-	    if (add_range(ranges, newp, size, tracenum, i) == 0)
-		return 0;
+		/* Check new block for correctness and add it to range list */
+		if (add_range(ranges, newp, size, tracenum, i, b->memlib) == 0)
+		    return 0;
 
-	    memset(newp, index & 0xFF, size);
+		memset(newp, index & 0xFF, size);
 
-            mm_free(oldp);
+		b->free(oldp);
+	    }
 
 	    /* Remember region */
 	    trace->blocks[index] = newp;
 	    trace->block_sizes[index] = size;
 	    break;
 
-        case FREE: /* mm_free */
+        case FREE: /* free */
 	    
-	    /* Remove region from list and call student's free function */
+	    /* Remove region from list and call the package's free function */
 	    p = trace->blocks[index];
 	    remove_range(ranges, p);
-	    mm_free(p);
+	    b->free(p);
 	    break;
 
 	default:
-	    app_error("Nonexistent request type in eval_mm_valid");
+	    app_error("Nonexistent request type in eval_valid");
         }
 
     }
 
-    mem_reset();
+    if (!check_stats(b, tracenum, trace->num_ops - 1))
+	return 0;
+
+    if (b->reset != NULL)
+	b->reset();
 
     /* As far as we know, this is a valid malloc package */
     return 1;
 }
 
 /* 
- * eval_mm_util - Evaluate the space utilization of the student's package
+ * eval_util - Evaluate the space utilization of a package that reports
+ *   its heap size.
  *   The idea is to remember the high water mark "hwm" of the heap for 
  *   an optimal allocator, i.e., no gaps and no internal fragmentation.
  *   Utilization is the ratio hwm/heapsize, where heapsize is the 
@@ -668,33 +1180,34 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
  *   package on the trace. Note that our implementation of mem_sbrk() 
  *   doesn't allow the students to decrement the brk pointer, so brk
  *   is always the high water mark of the heap. 
- *   
+ *   The peak and the average utilization are stored in stats.
  */
-static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges, double *inst_ratio)
+static void eval_util(backend_t *b, trace_t *trace, int tracenum, 
+		      stats_t *stats)
 {   
     int i;
     int index;
     int size, newsize, oldsize;
-    size_t max_total_size = 0, max_heap_size = 0;
     size_t heap_size = 0, total_size = 0;
-    double ratio, ratio_frac, accum_ratio_frac = 1.0, accum_ratio_exp = 0.0;
-    int ratio_exp;
+    util_acc_t util;
     char *p;
     char *newp, *oldp;
 
-    /* initialize the heap and the mm malloc package */
-    if (mm_init() < 0)
-	app_error("mm_init failed in eval_mm_util");
+    util_init(&util);
+
+    /* initialize the heap and the malloc package */
+    if (b->init != NULL && b->init() < 0)
+	app_error("init failed in eval_util");
 
     for (i = 0;  i < trace->num_ops;  i++) {
         switch (trace->ops[i].type) {
 
-        case ALLOC: /* mm_alloc */
+        case ALLOC: /* malloc */
 	    index = trace->ops[i].index;
 	    size = trace->ops[i].size;
 
-	    if ((p = mm_malloc(size)) == NULL) 
-		app_error("mm_malloc failed in eval_mm_util");
+	    if ((p = b->malloc(size)) == NULL) 
+		app_error("malloc failed in eval_util");
 	    
 	    /* Remember region and size */
 	    trace->blocks[index] = p;
@@ -706,16 +1219,16 @@ static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges, doubl
 
             break;
 
-	case REALLOC: /* mm_mealloc + mm_free */
+	case REALLOC: /* malloc + free */
 	    index = trace->ops[i].index;
 	    newsize = trace->ops[i].size;
 	    oldsize = trace->block_sizes[index];
 
 	    oldp = trace->blocks[index];
-	    if ((newp = mm_malloc(newsize)) == NULL)
-		app_error("mm_realloc failed in eval_mm_util");
+	    if ((newp = b->malloc(newsize)) == NULL)
+		app_error("realloc failed in eval_util");
 
-            mm_free(oldp);
+            b->free(oldp);
 
 	    /* Remember region and size */
 	    trace->blocks[index] = newp;
@@ -727,12 +1240,12 @@ static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges, doubl
             
 	    break;
 
-        case FREE: /* mm_free */
+        case FREE: /* free */
 	    index = trace->ops[i].index;
 	    size = trace->block_sizes[index];
 	    p = trace->blocks[index];
 	    
-	    mm_free(p);
+	    b->free(p);
 	    
 	    /* Keep track of current total size
 	     * of all allocated blocks */
@@ -741,184 +1254,940 @@ static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges, doubl
 	    break;
 
 	default:
-	    app_error("Nonexistent request type in eval_mm_util");
+	    app_error("Nonexistent request type in eval_util");
 
         }
 
     	    
         /* Update statistics */
-        max_total_size = ((total_size > max_total_size) ?
-                          total_size
-                          : max_total_size);
-
-        heap_size = mem_heapsize();
-        if (heap_size > max_heap_size)
-          max_heap_size = heap_size;
-
-        ratio = (double)(total_size + 1) / (heap_size + 1);
-
-        ratio_frac = frexp(ratio, &ratio_exp);
-
-        accum_ratio_frac *= ratio_frac;
-        accum_ratio_exp += ratio_exp;
-
-        accum_ratio_frac = frexp(accum_ratio_frac, &ratio_exp);
-        accum_ratio_exp += ratio_exp;
-        
-        // printf("%ld %ld %f\n", total_size, heap_size, ratio);
+        heap_size = b->heapsize();
+        util_update(&util, total_size, heap_size);
+        sample_heap(b, tracenum, i, trace->num_ops, total_size, heap_size);
     }
 
-    mem_reset();
-
-    ratio = accum_ratio_frac * pow(2, accum_ratio_exp / trace->num_ops);
-
-    // printf("%ld %f\n", max_total_size, ratio);
+    if (b->reset != NULL)
+	b->reset();
 
-    *inst_ratio = ratio;
-
-    return (double)max_total_size / max_heap_size;;
+    util_finish(&util, stats);
 }
 
 
 /*
- * eval_mm_speed - This is the function that is used by fcyc()
- *    to measure the running time of the mm malloc package.
+ * eval_speed - This is the function that is used by fcyc()
+ *    to measure the running time of a malloc package.
+ *    Initializing the package and resetting the heap are marked as
+ *    separate phases so that only the replay itself is timed.
  */
-static void eval_mm_speed(void *ptr)
+static void eval_speed(void *ptr)
 {
     int i, index, size, newsize;
     char *p, *newp, *oldp, *block;
     trace_t *trace = ((speed_t *)ptr)->trace;
+    backend_t *b = ((speed_t *)ptr)->backend;
 
-    /* Reset the heap and initialize the mm package */
-    if (mm_init() < 0) 
-	app_error("mm_init failed in eval_mm_speed");
+    /* Reset the heap and initialize the package */
+    fsecs_phase(FSECS_SETUP);
+    if (b->init != NULL && b->init() < 0) 
+	app_error("init failed in eval_speed");
+    speed_runs++;
+    perfctr_start();
+    fsecs_phase(FSECS_REPLAY);
 
     /* Interpret each trace request */
     for (i = 0;  i < trace->num_ops;  i++)
         switch (trace->ops[i].type) {
 
-        case ALLOC: /* mm_malloc */
+        case ALLOC: /* malloc */
             index = trace->ops[i].index;
             size = trace->ops[i].size;
-            if ((p = mm_malloc(size)) == NULL)
-		app_error("mm_malloc error in eval_mm_speed");
+            if ((p = b->malloc(size)) == NULL)
+		app_error("malloc error in eval_speed");
             trace->blocks[index] = p;
             break;
 
-	case REALLOC: /* mm_malloc + mm_free */
+	case REALLOC: /* malloc + free */
 	    index = trace->ops[i].index;
             newsize = trace->ops[i].size;
 	    oldp = trace->blocks[index];
-            if ((newp = mm_malloc(newsize)) == NULL)
-		app_error("mm_realloc error in eval_mm_speed");
-            mm_free(oldp);
+            if ((newp = b->malloc(newsize)) == NULL)
+		app_error("realloc error in eval_speed");
+            b->free(oldp);
             trace->blocks[index] = newp;
             break;
 
-        case FREE: /* mm_free */
+        case FREE: /* free */
             index = trace->ops[i].index;
             block = trace->blocks[index];
-            mm_free(block);
+            b->free(block);
             break;
 
 	default:
-	    app_error("Nonexistent request type in eval_mm_valid");
+	    app_error("Nonexistent request type in eval_speed");
         }
 
-    mem_reset();
+    fsecs_phase(FSECS_TEARDOWN);
+    perfctr_stop();
+    if (b->reset != NULL)
+	b->reset();
 }
 
 /*
- * eval_libc_valid - We run this function to make sure that the
- *    libc malloc can run to completion on the set of traces.
- *    We'll be conservative and terminate if any libc malloc call fails.
- *
+ * eval_latency - Replay the trace once on a malloc package, timing
+ *    each request by itself. A realloc is timed as the malloc and
+ *    free pair that implements it.
  */
-static int eval_libc_valid(trace_t *trace, int tracenum)
+static void eval_latency(backend_t *b, trace_t *trace, lathist_t *hists)
 {
-    int i, newsize;
-    char *p, *newp, *oldp;
+    int i, index, op = LAT_MALLOC;
+    char *p, *oldp;
+    uint64_t start, elapsed = 0;
+
+    if (b->init != NULL && b->init() < 0) 
+	app_error("init failed in eval_latency");
 
     for (i = 0;  i < trace->num_ops;  i++) {
+	index = trace->ops[i].index;
         switch (trace->ops[i].type) {
 
         case ALLOC: /* malloc */
-	    if ((p = malloc(trace->ops[i].size)) == NULL) {
-		malloc_error(tracenum, i, "libc malloc failed");
-		unix_error("System message");
-	    }
-	    trace->blocks[trace->ops[i].index] = p;
+	    start = lat_now();
+	    p = b->malloc(trace->ops[i].size);
+	    elapsed = lat_now() - start;
+	    if (p == NULL)
+		app_error("malloc error in eval_latency");
+	    trace->blocks[index] = p;
+	    op = LAT_MALLOC;
 	    break;
 
-	case REALLOC: /* realloc */
-            newsize = trace->ops[i].size;
-	    oldp = trace->blocks[trace->ops[i].index];
-	    if ((newp = realloc(oldp, newsize)) == NULL) {
-		malloc_error(tracenum, i, "libc realloc failed");
-		unix_error("System message");
-	    }
-	    trace->blocks[trace->ops[i].index] = newp;
+	case REALLOC: /* malloc + free */
+	    oldp = trace->blocks[index];
+	    start = lat_now();
+	    p = b->malloc(trace->ops[i].size);
+	    if (p != NULL)
+		b->free(oldp);
+	    elapsed = lat_now() - start;
+	    if (p == NULL)
+		app_error("realloc error in eval_latency");
+	    trace->blocks[index] = p;
+	    op = LAT_REALLOC;
 	    break;
-	    
+
         case FREE: /* free */
-	    free(trace->blocks[trace->ops[i].index]);
+	    p = trace->blocks[index];
+	    start = lat_now();
+	    b->free(p);
+	    elapsed = lat_now() - start;
+	    op = LAT_FREE;
 	    break;
 
 	default:
-	    app_error("invalid operation type  in eval_libc_valid");
-	}
+	    app_error("Nonexistent request type in eval_latency");
+        }
+	lathist_record(&hists[op], (elapsed > lat_ovhd) ? elapsed - lat_ovhd : 0);
     }
 
-    return 1;
+    if (b->reset != NULL)
+	b->reset();
 }
 
-/* 
- * eval_libc_speed - This is the function that is used by fcyc() to
- *    measure the running time of the libc malloc package on the set
- *    of traces.
+/*
+ * eval_fused - Check a malloc package for correctness on a trace and
+ *     measure its space utilization in the same replay, instead of in
+ *     separate eval_valid and eval_util passes (--fused). Reallocs go
+ *     to the package's realloc, when it has one, for both.
  */
-static void eval_libc_speed(void *ptr)
+static int eval_fused(backend_t *b, trace_t *trace, int tracenum, 
+		      range_t **ranges, stats_t *stats)
 {
-    int i;
-    int index, size, newsize;
-    char *p, *newp, *oldp, *block;
-    trace_t *trace = ((speed_t *)ptr)->trace;
+    int i, j;
+    int index, size, oldsize;
+    char *p, *newp, *oldp;
+    size_t total_size = 0, heap_size;
+    util_acc_t util;
+
+    clear_ranges(ranges);
+    util_init(&util);
+    if (b->init != NULL && b->init() < 0) {
+	malloc_error(tracenum, 0, "init failed.");
+	return 0;
+    }
 
     for (i = 0;  i < trace->num_ops;  i++) {
+	index = trace->ops[i].index;
+	size = trace->ops[i].size;
+
         switch (trace->ops[i].type) {
+
         case ALLOC: /* malloc */
-	    index = trace->ops[i].index;
-	    size = trace->ops[i].size;
-	    if ((p = malloc(size)) == NULL)
-		unix_error("malloc failed in eval_libc_speed");
+	    if ((p = b->malloc(size)) == NULL) {
+		malloc_error(tracenum, i, "malloc failed.");
+		return 0;
+	    }
+	    if (add_range(ranges, p, size, tracenum, i, b->memlib) == 0)
+		return 0;
+	    memset(p, index & 0xFF, size);
 	    trace->blocks[index] = p;
+	    trace->block_sizes[index] = size;
+	    total_size += size;
 	    break;
 
-	case REALLOC: /* realloc */
-	    index = trace->ops[i].index;
-	    newsize = trace->ops[i].size;
+        case REALLOC: /* realloc, or malloc + free */
 	    oldp = trace->blocks[index];
-	    if ((newp = malloc(newsize)) == NULL)
-		unix_error("malloc failed in eval_libc_speed\n");
-            free(oldp);
-	    
+	    oldsize = trace->block_sizes[index];
+	    if (b->realloc != NULL) {
+		if ((newp = b->realloc(oldp, size)) == NULL) {
+		    malloc_error(tracenum, i, "realloc failed.");
+		    return 0;
+		}
+		remove_range(ranges, oldp);
+		if (add_range(ranges, newp, size, tracenum, i, b->memlib) == 0)
+		    return 0;
+		for (j = 0; j < size && j < oldsize; j++) {
+		    if (newp[j] != (index & 0xFF)) {
+			malloc_error(tracenum, i, "realloc did not preserve "
+				     "the data from the old block.");
+			return 0;
+		    }
+		}
+	    }
+	    else {
+		if ((newp = b->malloc(size)) == NULL) {
+		    malloc_error(tracenum, i, "malloc failed.");
+		    return 0;
+		}
+		remove_range(ranges, oldp);
+		if (add_range(ranges, newp, size, tracenum, i, b->memlib) == 0)
+		    return 0;
+		b->free(oldp);
+	    }
+	    memset(newp, index & 0xFF, size);
 	    trace->blocks[index] = newp;
+	    trace->block_sizes[index] = size;
+	    total_size += (size - oldsize);
 	    break;
-	    
+
         case FREE: /* free */
-	    index = trace->ops[i].index;
-	    block = trace->blocks[index];
-	    free(block);
+	    p = trace->blocks[index];
+	    remove_range(ranges, p);
+	    b->free(p);
+	    total_size -= trace->block_sizes[index];
 	    break;
+
+	default:
+	    app_error("Nonexistent request type in eval_fused");
+        }
+
+	if (b->heapsize != NULL) {
+	    heap_size = b->heapsize();
+	    util_update(&util, total_size, heap_size);
+	    sample_heap(b, tracenum, i, trace->num_ops, total_size, 
+			heap_size);
 	}
     }
+
+    if (!check_stats(b, tracenum, trace->num_ops - 1))
+	return 0;
+
+    if (b->reset != NULL)
+	b->reset();
+
+    if (b->heapsize != NULL)
+	util_finish(&util, stats);
+    return 1;
+}
+
+/*
+ * eval_stream_valid - Check a malloc package for correctness on a
+ *     trace that is streamed rather than loaded, measuring its space
+ *     utilization in the same pass when it reports its heap size. Only
+ *     the live blocks are remembered, in the sparse live map.
+ */
+static int eval_stream_valid(backend_t *b, char *filename, int tracenum,
+			     range_t **ranges, stats_t *stats)
+{
+    trace_stream_t *s;
+    traceop_t *ops;
+    idmap_entry_t *e;
+    int i, j, n, opnum = 0, valid = 1;
+    int index, size, oldsize;
+    char *p, *newp;
+    size_t total_size = 0, heap_size;
+    util_acc_t util;
+
+    clear_ranges(ranges);
+    idmap_clear(&live);
+    util_init(&util);
+    if (b->init != NULL && b->init() < 0) {
+	malloc_error(tracenum, 0, "init failed.");
+	return 0;
+    }
+
+    s = trace_stream_open(tracedir, filename, STREAM_WINDOW);
+    stats->ops = trace_stream_ops(s);
+    while (valid && (ops = trace_stream_next(s, &n)) != NULL) {
+	for (i = 0; valid && i < n; i++, opnum++) {
+	    index = ops[i].index;
+	    size = ops[i].size;
+
+	    switch (ops[i].type) {
+
+	    case ALLOC: /* malloc */
+		if ((p = b->malloc(size)) == NULL) {
+		    malloc_error(tracenum, opnum, "malloc failed.");
+		    valid = 0;
+		    break;
+		}
+		if (add_range(ranges, p, size, tracenum, opnum, 
+			      b->memlib) == 0) {
+		    valid = 0;
+		    break;
+		}
+		memset(p, index & 0xFF, size);
+		e = idmap_put(&live, index);
+		e->ptr = p;
+		e->size = size;
+		total_size += size;
+		break;
+
+	    case REALLOC: /* realloc, or malloc + free */
+		if ((e = idmap_get(&live, index)) == NULL)
+		    app_error("Realloc of a block that is not allocated");
+		oldsize = e->size;
+		if (b->realloc != NULL) {
+		    if ((newp = b->realloc(e->ptr, size)) == NULL) {
+			malloc_error(tracenum, opnum, "realloc failed.");
+			valid = 0;
+			break;
+		    }
+		    remove_range(ranges, e->ptr);
+		    if (add_range(ranges, newp, size, tracenum, opnum,
+				  b->memlib) == 0) {
+			valid = 0;
+			break;
+		    }
+		    for (j = 0; j < size && j < oldsize; j++) {
+			if (newp[j] != (index & 0xFF)) {
+			    malloc_error(tracenum, opnum, "realloc did not "
+					 "preserve the data from the old block.");
+			    valid = 0;
+			    break;
+			}
+		    }
+		    if (!valid)
+			break;
+		}
+		else {
+		    if ((newp = b->malloc(size)) == NULL) {
+			malloc_error(tracenum, opnum, "malloc failed.");
+			valid = 0;
+			break;
+		    }
+		    remove_range(ranges, e->ptr);
+		    if (add_range(ranges, newp, size, tracenum, opnum,
+				  b->memlib) == 0) {
+			valid = 0;
+			break;
+		    }
+		    b->free(e->ptr);
+		}
+		memset(newp, index & 0xFF, size);
+		e->ptr = newp;
+		e->size = size;
+		total_size += (size - oldsize);
+		break;
+
+	    case FREE: /* free */
+		if ((e = idmap_get(&live, index)) == NULL)
+		    app_error("Free of a block that is not allocated");
+		remove_range(ranges, e->ptr);
+		b->free(e->ptr);
+		total_size -= e->size;
+		idmap_del(&live, index);
+		break;
+
+	    default:
+		app_error("Nonexistent request type in eval_stream_valid");
+	    }
+	    if (valid && b->heapsize != NULL) {
+		heap_size = b->heapsize();
+		util_update(&util, total_size, heap_size);
+		sample_heap(b, tracenum, opnum, stats->ops, total_size, 
+			    heap_size);
+	    }
+	}
+    }
+    trace_stream_close(s);
+    if (!valid || !check_stats(b, tracenum, stats->ops - 1))
+	return 0;
+
+    if (b->reset != NULL)
+	b->reset();
+
+    if (b->heapsize != NULL)
+	util_finish(&util, stats);
+    return 1;
+}
+
+/*
+ * util_init - Start accumulating the utilization of a replay
+ */
+static void util_init(util_acc_t *u)
+{
+    u->max_total_size = u->max_heap_size = 0;
+    u->accum_ratio_frac = 1.0;
+    u->accum_ratio_exp = 0.0;
+    u->nops = 0;
+}
+
+/*
+ * util_update - Account for one op, after which total_size bytes of
+ *     payload are live in a heap of heap_size bytes
+ */
+static void util_update(util_acc_t *u, size_t total_size, size_t heap_size)
+{
+    double ratio, ratio_frac;
+    int ratio_exp;
+
+    if (total_size > u->max_total_size)
+	u->max_total_size = total_size;
+    if (heap_size > u->max_heap_size)
+	u->max_heap_size = heap_size;
+
+    ratio = (double)(total_size + 1) / (heap_size + 1);
+    ratio_frac = frexp(ratio, &ratio_exp);
+    u->accum_ratio_frac *= ratio_frac;
+    u->accum_ratio_exp += ratio_exp;
+    u->accum_ratio_frac = frexp(u->accum_ratio_frac, &ratio_exp);
+    u->accum_ratio_exp += ratio_exp;
+    u->nops++;
+}
+
+/*
+ * sample_heap - Called after op opnum of nops in a utilization replay,
+ *     when total_size bytes are live in a heap of heap_size bytes.
+ *     Writes the --series output, if this op is one of its samples,
+ *     and takes the --frag snapshots.
+ */
+static void sample_heap(backend_t *b, int tracenum, int opnum, int nops,
+			size_t total_size, size_t heap_size)
+{
+    int stride = (nops + SERIES_POINTS - 1) / SERIES_POINTS;
+    int periodic, peak, i;
+    mm_heapinfo_t info;
+    double index;
+
+    if (series != NULL && 
+	(stride <= 1 || opnum % stride == 0 || opnum == nops - 1)) {
+	fprintf(series, "%s,%s,%d,%zu,%zu,", b->name, 
+		series_traces[tracenum], opnum, total_size, heap_size);
+	if (b->freebytes != NULL)
+	    fprintf(series, "%zu", b->freebytes());
+	fprintf(series, "\n");
+    }
+
+    /* A fragmentation snapshot every frag_interval ops, and whenever
+       the live bytes reach a new peak */
+    if (frag_cur == NULL || b->heapinfo == NULL)
+	return;
+    periodic = (opnum % frag_interval == 0);
+    peak = (total_size > frag_cur->peak_live);
+    if (!periodic && !peak)
+	return;
+    b->heapinfo(&info);
+    index = (info.free_bytes > 0) 
+	? 1.0 - (double)info.largest_free / info.free_bytes : 0.0;
+    if (periodic) {
+	frag_cur->snapshots++;
+	frag_cur->avg_index += (index - frag_cur->avg_index) 
+	    / frag_cur->snapshots;
+    }
+    if (peak) {
+	frag_cur->peak_live = total_size;
+	frag_cur->peak_index = index;
+	frag_cur->peak_free = info.free_bytes;
+	frag_cur->peak_largest = info.largest_free;
+	frag_cur->peak_chunks = info.chunks;
+	frag_cur->peak_occ = (info.chunk_bytes > 0) 
+	    ? (double)(info.chunk_bytes - info.free_bytes) / info.chunk_bytes
+	    : 0.0;
+	for (i = 0; i < MM_SIZE_BINS; i++)
+	    frag_cur->peak_hist[i] = info.free_hist[i];
+	for (i = 0; i < MM_OCC_BINS; i++)
+	    frag_cur->peak_chunk_occ[i] = info.chunk_occ[i];
+    }
+}
+
+/*
+ * util_finish - Store the peak and the average utilization in stats
+ */
+static void util_finish(util_acc_t *u, stats_t *stats)
+{
+    if (u->nops == 0)
+	return;
+    stats->util = (double)u->max_total_size / u->max_heap_size;
+    stats->inst_util = u->accum_ratio_frac 
+	* pow(2, u->accum_ratio_exp / u->nops);
+}
+
+/*
+ * eval_stream_speed - The streaming counterpart of eval_speed, used by
+ *    fcyc(). The timed replay includes the live map lookups and any
+ *    waits for the reader, so its throughput is lower than that of an
+ *    in-memory replay.
+ */
+static void eval_stream_speed(void *ptr)
+{
+    speed_t *params = ptr;
+    backend_t *b = params->backend;
+    trace_stream_t *s;
+    traceop_t *ops;
+    idmap_entry_t *e;
+    char *newp;
+    int i, n;
+
+    /* Open the stream, which starts reading ahead, and initialize */
+    fsecs_phase(FSECS_SETUP);
+    idmap_clear(&live);
+    if (b->init != NULL && b->init() < 0) 
+	app_error("init failed in eval_stream_speed");
+    s = trace_stream_open(tracedir, params->tracefile, STREAM_WINDOW);
+    speed_runs++;
+    perfctr_start();
+    fsecs_phase(FSECS_REPLAY);
+
+    while ((ops = trace_stream_next(s, &n)) != NULL) {
+	for (i = 0; i < n; i++) {
+	    switch (ops[i].type) {
+
+	    case ALLOC: /* malloc */
+		e = idmap_put(&live, ops[i].index);
+		if ((e->ptr = b->malloc(ops[i].size)) == NULL)
+		    app_error("malloc error in eval_stream_speed");
+		break;
+
+	    case REALLOC: /* malloc + free */
+		e = idmap_get(&live, ops[i].index);
+		if ((newp = b->malloc(ops[i].size)) == NULL)
+		    app_error("realloc error in eval_stream_speed");
+		b->free(e->ptr);
+		e->ptr = newp;
+		break;
+
+	    case FREE: /* free */
+		e = idmap_get(&live, ops[i].index);
+		b->free(e->ptr);
+		idmap_del(&live, ops[i].index);
+		break;
+
+	    default:
+		app_error("Nonexistent request type in eval_stream_speed");
+	    }
+	}
+    }
+
+    fsecs_phase(FSECS_TEARDOWN);
+    perfctr_stop();
+    trace_stream_close(s);
+    if (b->reset != NULL)
+	b->reset();
+}
+
+/*
+ * eval_backend - Run a malloc package through the validity, utilization
+ *     and speed passes on each of the n traces, filling in their stats.
+ *     Utilization is only measured if the package reports its heap size.
+ *     With --stream, validity and utilization are checked in one pass,
+ *     and latency is not measured.
+ *     Only errors in the mm package count against its perf index.
+ */
+static void eval_backend(backend_t *b, char **tracefiles, int n, 
+			 stats_t *stats, int latency)
+{
+    int i;
+    int saved_errors = errors;
+    range_t *ranges = NULL;
+
+    if (jobs > 1 && n > 1)
+	eval_parallel(b, tracefiles, n, stats, latency);
+    else {
+	for (i=0; i < n; i++)
+	    eval_trace(b, tracefiles[i], i, &ranges, &stats[i], latency);
+	clear_ranges(&ranges);
+    }
+
+    if (b != &mm_backend)
+	errors = saved_errors;
+}
+
+/*
+ * eval_trace - Evaluate backend b on one trace, filling in its stats
+ */
+static void eval_trace(backend_t *b, char *tracefile, int tracenum,
+		       range_t **ranges, stats_t *stats, int latency)
+{
+    trace_t *trace;
+    speed_t speed_params;
+
+    memset(&stats->frag, 0, sizeof(stats->frag));
+    frag_cur = frag_interval ? &stats->frag : NULL;
+
+    if (stream) {
+	if (verbose > 1)
+	    printf("Streaming %s malloc on %s for correctness, %s"
+		   "and performance.\n", b->name, tracefile,
+		   b->heapsize ? "efficiency, " : "");
+	stats->valid = eval_stream_valid(b, tracefile, tracenum, ranges,
+					 stats);
+	if (stats->valid) {
+	    speed_params.tracefile = tracefile;
+	    speed_params.backend = b;
+	    speed_acquire();
+	    time_speed(eval_stream_speed, &speed_params, stats);
+	    speed_release();
+	}
+	return;
+    }
+
+    if (verbose > 1)
+	printf("Reading tracefile: %s\n", tracefile);
+    trace = read_trace(tracedir, tracefile);
+    stats->ops = trace->num_ops;
+    if (verbose > 1)
+	printf("Checking %s malloc for correctness, ", b->name);
+    if (fused)
+	stats->valid = eval_fused(b, trace, tracenum, ranges, stats);
+    else
+	stats->valid = eval_valid(b, trace, tracenum, ranges);
+    if (stats->valid) {
+	if (verbose > 1 && b->heapsize != NULL)
+	    printf("efficiency, ");
+	if (b->heapsize != NULL && !fused)
+	    eval_util(b, trace, tracenum, stats);
+	speed_params.trace = trace;
+	speed_params.ranges = *ranges;
+	speed_params.backend = b;
+	if (verbose > 1)
+	    printf("and performance.\n");
+	speed_acquire();
+	time_speed(eval_speed, &speed_params, stats);
+	if (latency)
+	    measure_latency(b, trace, stats->lat);
+	speed_release();
+    }
+    free_trace(trace);
+}
+
+/*
+ * eval_parallel - Evaluate the traces in up to jobs worker processes at
+ *     once, each on its own CPU, and gather their stats over pipes.
+ *     Workers are processes rather than threads because mm.c and
+ *     memlib keep their state in globals.
+ */
+static void eval_parallel(backend_t *b, char **tracefiles, int n, 
+			  stats_t *stats, int latency)
+{
+    pid_t pids[MAXJOBS];     /* worker in each slot, or 0 if idle */
+    int fds[MAXJOBS];        /* ... the pipe its result comes back on */
+    FILE *rows[MAXJOBS];     /* ... and the file of its --series rows */
+    struct pollfd pfds[MAXJOBS];
+    int slots[MAXJOBS];      /* slot of each pfds entry */
+    job_result_t res;
+    int i, k, npoll, status;
+    int next = 0, running = 0;
+    ssize_t got, rc;
+
+    for (k = 0; k < jobs; k++) {
+	pids[k] = 0;
+	rows[k] = NULL;
+	if (series != NULL && (rows[k] = tmpfile()) == NULL)
+	    unix_error("tmpfile failed in eval_parallel");
+    }
+
+    while (next < n || running > 0) {
+	/* Hand the next traces to any idle workers */
+	for (k = 0; k < jobs && next < n; k++) {
+	    if (pids[k] != 0)
+		continue;
+	    pids[k] = start_worker(b, tracefiles, next++, stats, latency,
+				   cpus[k % ncpus], rows[k], &fds[k]);
+	    running++;
+	}
+
+	/* Wait for any of them to finish */
+	npoll = 0;
+	for (k = 0; k < jobs; k++) {
+	    if (pids[k] == 0)
+		continue;
+	    pfds[npoll].fd = fds[k];
+	    pfds[npoll].events = POLLIN;
+	    slots[npoll++] = k;
+	}
+	if (poll(pfds, npoll, -1) < 0) {
+	    if (errno == EINTR)
+		continue;
+	    unix_error("poll failed in eval_parallel");
+	}
+
+	for (i = 0; i < npoll; i++) {
+	    if (pfds[i].revents == 0)
+		continue;
+	    k = slots[i];
+	    for (got = 0; got < sizeof(res); got += rc) {
+		rc = read(fds[k], (char *)&res + got, sizeof(res) - got);
+		if (rc < 0 && errno == EINTR)
+		    rc = 0;
+		else if (rc <= 0)
+		    break;
+	    }
+	    close(fds[k]);
+	    waitpid(pids[k], &status, 0);
+	    pids[k] = 0;
+	    running--;
+
+	    /* A worker that died took its trace with it, as it would
+	       have taken the whole driver without -j */
+	    if (got != sizeof(res)) {
+		for (k = 0; k < jobs; k++)
+		    if (pids[k] != 0)
+			kill(pids[k], SIGKILL);
+		while (wait(NULL) > 0)
+		    ;
+		if (WIFSIGNALED(status))
+		    sprintf(msg, "worker for %s malloc was killed by signal %d",
+			    b->name, WTERMSIG(status));
+		else
+		    sprintf(msg, "worker for %s malloc exited without results",
+			    b->name);
+		app_error(msg);
+	    }
+	    stats[res.tracenum] = res.stats;
+	    errors += res.errors;
+	    if (rows[k] != NULL)
+		copy_rows(rows[k]);
+	}
+    }
+    for (k = 0; k < jobs; k++)
+	if (rows[k] != NULL)
+	    fclose(rows[k]);
+}
+
+/*
+ * copy_rows - Append the --series rows that a worker left in rows to
+ *     the series file, and empty rows for the slot's next worker. Only
+ *     the driver writes to the series file, so the rows of workers
+ *     running at the same time never interleave.
+ */
+static void copy_rows(FILE *rows)
+{
+    char buf[8192];
+    size_t n;
+
+    rewind(rows);
+    while ((n = fread(buf, 1, sizeof(buf), rows)) > 0)
+	fwrite(buf, 1, n, series);
+    if (ferror(rows) || ftruncate(fileno(rows), 0) < 0)
+	unix_error("could not copy the --series rows of a worker");
+    rewind(rows);
+}
+
+/*
+ * start_worker - Fork a worker that evaluates one trace on the given
+ *     CPU and writes a job_result_t to the pipe returned in *fd, and
+ *     any --series rows to rows
+ */
+static pid_t start_worker(backend_t *b, char **tracefiles, int tracenum,
+			  stats_t *stats, int latency, int cpu, FILE *rows,
+			  int *fd)
+{
+    int p[2];
+    pid_t pid;
+    cpu_set_t set;
+    job_result_t res;
+    range_t *ranges = NULL;
+    ssize_t done, rc;
+
+    if (pipe(p) < 0)
+	unix_error("pipe failed in start_worker");
+    fflush(NULL);  /* or the worker would write it out again */
+    if ((pid = fork()) < 0)
+	unix_error("fork failed in start_worker");
+
+    if (pid > 0) {
+	close(p[1]);
+	*fd = p[0];
+	return pid;
+    }
+
+    /* The worker */
+    close(p[0]);
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    if (sched_setaffinity(0, sizeof(set), &set) < 0)
+	unix_error("sched_setaffinity failed in start_worker");
+    perfctr_reopen();
+    if (series != NULL)  /* the driver copies them into the series file */
+	series = rows;
+    errors = 0;
+    res.tracenum = tracenum;
+    res.stats = stats[tracenum];
+    eval_trace(b, tracefiles[tracenum], tracenum, &ranges, &res.stats, 
+	       latency);
+    res.errors = errors;
+    for (done = 0; done < sizeof(res); done += rc) {
+	rc = write(p[1], (char *)&res + done, sizeof(res) - done);
+	if (rc < 0 && errno == EINTR)
+	    rc = 0;
+	else if (rc < 0)
+	    break;
+    }
+    fflush(stdout);
+    if (series != NULL)
+	fflush(series);
+    evlog_close();  /* _exit skips the handler that would write it out */
+    _exit(0);
+}
+
+/*
+ * measure_latency - Collect per-op latency histograms for a trace over
+ *    LATENCY_RUNS replays and store their percentiles in lat
+ */
+static void measure_latency(backend_t *b, trace_t *trace, latsum_t *lat)
+{
+    int i;
+
+    for (i = 0; i < LAT_NOPS; i++)
+	lathist_clear(&lat_hists[i]);
+    for (i = 0; i < LATENCY_RUNS; i++)
+	eval_latency(b, trace, lat_hists);
+    for (i = 0; i < LAT_NOPS; i++)
+	lathist_summarize(&lat_hists[i], &lat[i]);
+}
+
+/*
+ * time_speed - Time one of the xxx_speed routines on a trace, either
+ *    with fsecs or, in rigorous mode, by repeated sampling. Any event
+ *    counters are totalled over all of the timed runs.
+ */
+static void time_speed(fsecs_test_funct f, speed_t *params, stats_t *stats)
+{
+    perfctr_clear();
+    mem_clear_stats();
+    if (params->backend->phase_clear)
+	params->backend->phase_clear();
+    if (params->backend->counts_clear)
+	params->backend->counts_clear();
+    speed_runs = 0;
+    if (rigorous)
+	stats->secs = fsecs_stats(f, params, &timing_params, &stats->timing);
+    else
+	stats->secs = fsecs(f, params);
+    fsecs_phase_secs(stats->phase_secs);
+    perfctr_read(&stats->counters);
+    if (params->backend->memlib) {
+	mem_get_stats(&stats->mem);
+	stats->mem_runs = speed_runs;
+    }
+    if (params->backend->phase_get)
+	stats->phased = params->backend->phase_get(&stats->phases);
+    if (params->backend->counts_get) {
+	params->backend->counts_get(&stats->mm_counts);
+	stats->counts_runs = speed_runs;
+    }
 }
 
 /*************************************
  * Some miscellaneous helper routines
  ************************************/
 
+/*
+ * pin_cpu - Bind the driver to one CPU so that timings are not
+ *     disturbed by migrations
+ */
+static void pin_cpu(int cpu)
+{
+    cpu_set_t set;
+
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    if (sched_setaffinity(0, sizeof(set), &set) < 0)
+	unix_error("sched_setaffinity failed in pin_cpu");
+    if (verbose)
+	printf("Pinned to CPU %d.\n", cpu);
+}
+
+/*
+ * no_aslr - Restart the driver once with address space randomization
+ *     off, so that its own allocations land at the same addresses in
+ *     every run. If that is not allowed, carry on randomized.
+ */
+static void no_aslr(char **argv)
+{
+    int pers = personality(0xffffffff);
+
+    if (pers < 0 || (pers & ADDR_NO_RANDOMIZE))
+	return;
+    if (personality(pers | ADDR_NO_RANDOMIZE) < 0)
+	return;
+    fflush(NULL);
+    execv("/proc/self/exe", argv);
+    if (verbose)
+	printf("Could not restart without ASLR: %s\n", strerror(errno));
+}
+
+
+/*
+ * init_jobs - Find the CPUs that the workers can be pinned to, and set
+ *     up the token that serializes their timing if asked to
+ */
+static void init_jobs(int serial_speed)
+{
+    cpu_set_t set;
+    int cpu;
+    char c = 0;
+
+    if (sched_getaffinity(0, sizeof(set), &set) < 0)
+	unix_error("sched_getaffinity failed in init_jobs");
+    ncpus = 0;
+    for (cpu = 0; cpu < CPU_SETSIZE && ncpus < MAXJOBS; cpu++)
+	if (CPU_ISSET(cpu, &set))
+	    cpus[ncpus++] = cpu;
+    if (jobs > ncpus)
+	printf("Warning: %d workers will share %d CPU%s, which disturbs "
+	       "their timings\n", jobs, ncpus, (ncpus > 1) ? "s" : "");
+    if (verbose)
+	printf("Evaluating up to %d traces at once%s.\n", jobs,
+	       serial_speed ? ", timing one at a time" : "");
+
+    if (serial_speed) {
+	if (pipe(speed_lock) < 0 || write(speed_lock[1], &c, 1) != 1)
+	    unix_error("could not create the speed lock");
+    }
+}
+
+/*
+ * speed_acquire - Wait for the speed token, with --serial-speed
+ */
+static void speed_acquire(void)
+{
+    char c;
+
+    if (speed_lock[0] < 0)
+	return;
+    while (read(speed_lock[0], &c, 1) != 1)
+	if (errno != EINTR)
+	    unix_error("could not take the speed lock");
+}
+
+/*
+ * speed_release - Pass the speed token on to the next worker
+ */
+static void speed_release(void)
+{
+    char c = 0;
+
+    if (speed_lock[1] >= 0 && write(speed_lock[1], &c, 1) != 1)
+	unix_error("could not release the speed lock");
+}
 
 /*
  * printresults - prints a performance summary for some malloc package
@@ -930,13 +2199,23 @@ static void printresults(int n, stats_t *stats)
     double ops = 0;
     double util = 0;
     double inst_util = 0;
+    int counted = 0;
+
+    for (i=0; i < n; i++)
+	if (stats[i].valid && stats[i].counts_runs > 0)
+	    counted = 1;
 
-    /* Print the individual results for each trace */
-    printf("%5s%7s %5s%7s%7s%10s%6s\n", 
+    /* Print the individual results for each trace, with how mm searched
+       and reshaped its heap when it counts that */
+    printf("%5s%7s %5s%7s%7s%10s%6s", 
 	   "trace", " valid", "util", "util_i", "ops", "secs", "Kops");
+    if (counted)
+	printf("%8s%7s%7s%8s%7s", "visits", "split", "merge", "extend",
+	       "unmap");
+    printf("\n");
     for (i=0; i < n; i++) {
 	if (stats[i].valid) {
-	    printf("%2d%10s%5.0f%%%5.0f%%%8.0f%10.6f%6.0f\n", 
+	    printf("%2d%10s%5.0f%%%5.0f%%%8.0f%10.6f%6.0f", 
 		   i,
 		   "yes",
 		   stats[i].util*100.0,
@@ -944,6 +2223,9 @@ static void printresults(int n, stats_t *stats)
 		   stats[i].ops,
 		   stats[i].secs,
 		   (stats[i].ops/1e3)/stats[i].secs);
+	    if (stats[i].counts_runs > 0)
+		printcounts(&stats[i]);
+	    printf("\n");
 	    secs += stats[i].secs;
 	    ops += stats[i].ops;
 	    util += stats[i].util;
@@ -982,6 +2264,347 @@ static void printresults(int n, stats_t *stats)
 
 }
 
+/*
+ * printcounts - prints, on the results line of a trace, the free blocks
+ *     visited per search, the share of mallocs that split a block and
+ *     of frees that merged with a neighbor, and the chunks mapped and
+ *     unmapped per replay
+ */
+static void printcounts(stats_t *s)
+{
+    mm_counts_t *c = &s->mm_counts;
+    double frees = 0;
+    int k;
+
+    for (k = 0; k < MM_COALESCE_CASES; k++)
+	frees += c->coalesce[k];
+    printf("%8.1f%6.0f%%%6.0f%%%8.1f%7.1f",
+	   c->searches ? (double)c->visited / c->searches : 0.0,
+	   c->searches ? 100.0 * c->splits / c->searches : 0.0,
+	   frees ? 100.0 * (frees - c->coalesce[MM_COALESCE_NONE]) / frees : 0.0,
+	   (double)c->extends / s->counts_runs,
+	   (double)c->unmaps / s->counts_runs);
+}
+
+/*
+ * printsearch - prints how many free blocks mm's searches visited, as
+ *     the share of searches in each power-of-2 bin, and how its frees
+ *     coalesced
+ */
+static void printsearch(int n, stats_t *stats)
+{
+    int i, bin, top = 1;
+    double total;
+    mm_counts_t *c;
+
+    for (i=0; i < n; i++)
+	for (bin = 0; bin < MM_SEARCH_BINS; bin++)
+	    if (stats[i].counts_runs > 0 && stats[i].mm_counts.search_hist[bin])
+		top = (bin + 1 > top) ? bin + 1 : top;
+
+    printf("%5s%7s", "trace", "miss");
+    printf("%7s", "0");
+    for (bin = 1; bin < top; bin++)
+	printf("%7lu", 1UL << (bin - 1));
+    printf("  (%% of searches visiting n to 2n-1 blocks)\n");
+    for (i=0; i < n; i++) {
+	if (!stats[i].valid || stats[i].counts_runs == 0)
+	    continue;
+	c = &stats[i].mm_counts;
+	total = c->searches ? c->searches : 1;
+	printf("%2d%9.1f%%", i, 100.0 * c->misses / total);
+	for (bin = 0; bin < top; bin++)
+	    printf("%6.1f%%", 100.0 * c->search_hist[bin] / total);
+	printf("\n");
+    }
+
+    printf("%5s%10s%10s%10s%10s  (frees per replay, by free neighbors)\n",
+	   "trace", "none", "next", "prev", "both");
+    for (i=0; i < n; i++) {
+	if (!stats[i].valid || stats[i].counts_runs == 0)
+	    continue;
+	c = &stats[i].mm_counts;
+	printf("%2d%13.1f%10.1f%10.1f%10.1f\n", i,
+	       (double)c->coalesce[MM_COALESCE_NONE] / stats[i].counts_runs,
+	       (double)c->coalesce[MM_COALESCE_NEXT] / stats[i].counts_runs,
+	       (double)c->coalesce[MM_COALESCE_PREV] / stats[i].counts_runs,
+	       (double)c->coalesce[MM_COALESCE_BOTH] / stats[i].counts_runs);
+    }
+}
+
+/*
+ * printtiming - prints the distribution of the timed samples of some
+ *     malloc package, as collected in rigorous mode
+ */
+static void printtiming(int n, stats_t *stats)
+{
+    int i;
+    ftimer_stats_t *t;
+
+    printf("%5s%6s%10s%10s%10s%10s%8s\n",
+	   "trace", "reps", "min", "median", "mean", "stddev", "ci95");
+    for (i=0; i < n; i++) {
+	if (!stats[i].valid)
+	    continue;
+	t = &stats[i].timing;
+	printf("%2d%9d%10.6f%10.6f%10.6f%10.6f%7.2f%%\n",
+	       i,
+	       t->reps,
+	       t->min,
+	       t->median,
+	       t->mean,
+	       t->stddev,
+	       100.0 * t->ci95 / t->mean);
+    }
+}
+
+/*
+ * printphases - prints the average time per run (in usecs) spent
+ *     setting up, replaying and tearing down each trace. Only replay 
+ *     time counts toward throughput.
+ */
+static void printphases(int n, stats_t *stats)
+{
+    int i;
+
+    printf("%5s%12s%12s%12s  (usecs)\n", "trace", "setup", "replay", "teardown");
+    for (i=0; i < n; i++) {
+	if (!stats[i].valid)
+	    continue;
+	printf("%2d%15.3f%12.3f%12.3f\n",
+	       i,
+	       stats[i].phase_secs[FSECS_SETUP] * 1e6,
+	       stats[i].phase_secs[FSECS_REPLAY] * 1e6,
+	       stats[i].phase_secs[FSECS_TEARDOWN] * 1e6);
+    }
+}
+
+/*
+ * printsyscalls - prints the mmap and munmap calls that memlib made in
+ *     an average timed replay, and the share of the replay time they
+ *     took. Noise pages, which memlib maps to simulate other processes,
+ *     are counted apart. With -V, also prints the sizes of the mappings.
+ */
+static void printsyscalls(int n, stats_t *stats)
+{
+    int i, j;
+    double r, secs;
+    mem_stats_t *m;
+
+    printf("%5s%9s%10s%9s%10s%10s%7s%8s\n", "trace", "mmap", "mmap_KB",
+	   "munmap", "munmap_KB", "usecs", "share", "noise");
+    for (i=0; i < n; i++) {
+	if (!stats[i].valid || stats[i].mem_runs == 0)
+	    continue;
+	m = &stats[i].mem;
+	r = stats[i].mem_runs;
+	secs = (m->map_secs + m->unmap_secs) / r;
+	printf("%2d%12.1f%10.0f%9.1f%10.0f%10.1f%6.1f%%%8.1f\n",
+	       i,
+	       m->maps / r,
+	       m->map_bytes / r / 1024,
+	       m->unmaps / r,
+	       m->unmap_bytes / r / 1024,
+	       secs * 1e6,
+	       (stats[i].secs > 0) ? 100.0 * secs / stats[i].secs : 0.0,
+	       m->noise_maps / r);
+	if (verbose > 1) {
+	    printf("      mappings by pages:");
+	    for (j = 0; j < MEM_SIZE_BINS; j++)
+		if (m->map_hist[j] > 0)
+		    printf(" %d-%d:%.1f", 1 << j, (2 << j) - 1, 
+			   m->map_hist[j] / r);
+	    printf("\n");
+	}
+    }
+}
+
+/*
+ * printmmphases - prints, for an mm.c built with MM_PROFILE, the
+ *     thousands of cycles per replay spent in each of its phases, and
+ *     the average cycles per call of each
+ */
+static void printmmphases(int n, stats_t *stats)
+{
+    static const char *names[MM_NPHASES] = {
+	"find_fit", "split", "coalesce", "extend", "unmap"
+    };
+    int i, ph;
+    double r;
+    mm_phases_t *p;
+
+    printf("%5s", "trace");
+    for (ph = 0; ph < MM_NPHASES; ph++)
+	printf("%10s", names[ph]);
+    printf("  (kcycles per replay)");
+    for (ph = 0; ph < MM_NPHASES; ph++)
+	printf("%10s", names[ph]);
+    printf("  (cycles per call)\n");
+    for (i=0; i < n; i++) {
+	if (!stats[i].valid || !stats[i].phased || stats[i].mem_runs == 0)
+	    continue;
+	p = &stats[i].phases;
+	r = stats[i].mem_runs;
+	printf("%2d   ", i);
+	for (ph = 0; ph < MM_NPHASES; ph++)
+	    printf("%10.1f", p->cycles[ph] / r / 1e3);
+	printf("%23s", "");
+	for (ph = 0; ph < MM_NPHASES; ph++)
+	    printf("%10.0f", p->calls[ph] ? (double)p->cycles[ph] / p->calls[ph] : 0.0);
+	printf("\n");
+    }
+}
+
+/*
+ * printcounters - prints the events counted per op while replaying
+ *     each trace. Counts marked with * come from getrusage rather than
+ *     perf_event_open; events that could not be counted print as "-".
+ */
+static void printcounters(int n, stats_t *stats)
+{
+    int i, e;
+    perfctr_t *pc;
+    double ops;
+
+    printf("%5s%8s%8s%6s%9s%9s%9s%9s%9s%9s\n", "trace", "instr", "cycles",
+	   "IPC", "L1D-miss", "LLC-miss", "dTLB-mis", "br-miss", "faults", 
+	   "ctx-sw");
+    for (i=0; i < n; i++) {
+	if (!stats[i].valid)
+	    continue;
+	pc = &stats[i].counters;
+	ops = stats[i].ops * pc->regions;
+	printf("%2d   ", i);
+	for (e = 0; e < PC_NEVENTS; e++) {
+	    if (pc->source[e] == PC_NONE || ops == 0)
+		printf("%*s", (e < 2) ? 8 : 9, "-");
+	    else
+		printf((e < 2) ? "%8.1f" : "%8.4f%s", pc->counts[e] / ops,
+		       (pc->source[e] == PC_RUSAGE) ? "*" : " ");
+	    if (e == PC_CYCLES) {
+		if (pc->source[PC_INSTRUCTIONS] == PC_PERF
+		    && pc->source[PC_CYCLES] == PC_PERF && pc->counts[PC_CYCLES] > 0)
+		    printf("%6.2f", pc->counts[PC_INSTRUCTIONS] 
+			   / pc->counts[PC_CYCLES]);
+		else
+		    printf("%6s", "-");
+	    }
+	}
+	printf("\n");
+    }
+}
+
+/*
+ * printlatency - prints the per-op latency percentiles of some malloc
+ *     package. Times are in ns, with the timer overhead removed.
+ */
+static void printlatency(int n, stats_t *stats)
+{
+    int i, op;
+    latsum_t *l;
+
+    printf("%5s %8s%9s%8s%8s%8s%10s\n",
+	   "trace", "op", "count", "p50", "p99", "p99.9", "max");
+    for (i=0; i < n; i++) {
+	if (!stats[i].valid)
+	    continue;
+	for (op = 0; op < LAT_NOPS; op++) {
+	    l = &stats[i].lat[op];
+	    if (l->count == 0)
+		continue;
+	    printf("%2d    %8s%9.0f%8.0f%8.0f%8.0f%10.0f\n",
+		   i,
+		   lat_op_names[op],
+		   l->count,
+		   l->p50,
+		   l->p99,
+		   l->p999,
+		   l->max);
+	}
+    }
+    printf("timer overhead of %" PRIu64 " ns subtracted from each op\n",
+	   lat_ovhd);
+}
+
+/*
+ * printfrag - prints the fragmentation snapshots of each trace: the
+ *     mean external fragmentation index, and the index, free bytes,
+ *     largest free block, chunks and chunk occupancy at peak live size
+ */
+static void printfrag(int n, stats_t *stats)
+{
+    int i;
+    fragsum_t *f;
+
+    printf("%5s %6s %9s %10s %9s %10s %10s %7s %5s\n",
+	   "trace", "snaps", "avg_frag", "peak_live", "peak_frag", "free",
+	   "largest", "chunks", "occ");
+    for (i=0; i < n; i++) {
+	f = &stats[i].frag;
+	if (!stats[i].valid || f->snapshots == 0)
+	    continue;
+	printf("%2d    %6d %9.3f %10.0f %9.3f %10.0f %10.0f %7.0f %4.0f%%\n",
+	       i,
+	       f->snapshots,
+	       f->avg_index,
+	       f->peak_live,
+	       f->peak_index,
+	       f->peak_free,
+	       f->peak_largest,
+	       f->peak_chunks,
+	       f->peak_occ * 100.0);
+    }
+}
+
+/*
+ * printratios - prints the throughput of some malloc package next to
+ *     that of the libc reference on each trace. A ratio above 1 means
+ *     it was faster than libc.
+ */
+static void printratios(int n, stats_t *stats, stats_t *ref)
+{
+    int i;
+    double kops, ref_kops;
+
+    printf("%5s%10s%10s%8s\n", "trace", "Kops", "libc", "ratio");
+    for (i=0; i < n; i++) {
+	if (!stats[i].valid || !ref[i].valid)
+	    continue;
+	kops = (stats[i].ops/1e3)/stats[i].secs;
+	ref_kops = (ref[i].ops/1e3)/ref[i].secs;
+	printf("%2d%13.0f%10.0f%8.2f\n", i, kops, ref_kops, kops/ref_kops);
+    }
+}
+
+/*
+ * printcomparison - prints the totals of each malloc package side by
+ *     side, with its throughput relative to mm, which comes last
+ */
+static void printcomparison(results_t *res, int nres)
+{
+    int i;
+    results_t *r, *mm = &res[nres-1];
+    double kops, mm_kops = (mm->ops/1e3)/mm->secs;
+
+    printf("%-12s%6s%7s%7s%10s%7s\n",
+	   "malloc", "valid", "util", "util_i", "Kops", "vs mm");
+    for (i=0; i < nres; i++) {
+	r = &res[i];
+	kops = (r->ops/1e3)/r->secs;
+	printf("%-12.12s%3d/%-2d", r->name, r->numcorrect, r->n);
+	if (r->has_util)
+	    printf("%6.0f%%%6.0f%%", r->util*100.0, r->inst_util*100.0);
+	else
+	    printf("%7s%7s", "-", "-");
+	if (r->numcorrect == 0)
+	    printf("%10s%7s\n", "-", "-");
+	else if (mm->numcorrect == 0)
+	    printf("%10.0f%7s\n", kops, "-");
+	else
+	    printf("%10.0f%7.2f\n", kops, kops/mm_kops);
+    }
+}
+
 /* 
  * app_error - Report an arbitrary application error
  */
@@ -1014,13 +2637,63 @@ void malloc_error(int tracenum, int opnum, char *msg)
  */
 static void usage(void) 
 {
-    fprintf(stderr, "Usage: mdriver [-hvVal] [-f <file>] [-t <dir>]\n");
+    fprintf(stderr, "Usage: mdriver [-hvVaLl] [-f <file>] [-t <dir>] [-j <n>]\n");
     fprintf(stderr, "Options\n");
     fprintf(stderr, "\t-f <file>  Use <file> as the trace file.\n");
     fprintf(stderr, "\t-g         Generate summary info for autograder.\n");
     fprintf(stderr, "\t-h         Print this message.\n");
     fprintf(stderr, "\t-l         Run libc malloc as well.\n");
+    fprintf(stderr, "\t--backend=<b>  Run another malloc package as well: libc,\n");
+    fprintf(stderr, "\t           or path.so[:prefix] exporting prefix malloc,\n");
+    fprintf(stderr, "\t           free and optionally init, realloc, reset,\n");
+    fprintf(stderr, "\t           heapsize, free_bytes, heapinfo, phase_get,\n");
+    fprintf(stderr, "\t           phase_clear, counts_get, counts_clear and\n");
+    fprintf(stderr, "\t           get_stats. May be repeated.\n");
+    fprintf(stderr, "\t-L         Report per-op latency percentiles.\n");
     fprintf(stderr, "\t-t <dir>   Directory to find default traces.\n");
     fprintf(stderr, "\t-v         Print per-trace performance breakdowns.\n");
     fprintf(stderr, "\t-V         Print additional debug info.\n");
+    fprintf(stderr, "Output options\n");
+    fprintf(stderr, "\t--format=<f>   Also write results as json or csv.\n");
+    fprintf(stderr, "\t--out=<file>   Write them to <file> (default stdout).\n");
+    fprintf(stderr, "\t--baseline=<file>  Compare with a --format=json run; exit 2\n");
+    fprintf(stderr, "\t               on any regression.\n");
+    fprintf(stderr, "\t--threshold=<pct>  Allowed throughput/util loss (default %g).\n",
+	    BASELINE_THRESHOLD);
+    fprintf(stderr, "\t--lat-threshold=<pct>  Allowed p99 latency growth (default %g).\n",
+	    BASELINE_LAT_THRESHOLD);
+    fprintf(stderr, "\t--calibrate   Base the perf index on libc malloc measured on\n");
+    fprintf(stderr, "\t               this host (cached in $MDRIVER_CACHE or\n");
+    fprintf(stderr, "\t               ~/.cache/mdriver).\n");
+    fprintf(stderr, "\t--recalibrate Same, but ignore any cached measurement.\n");
+    fprintf(stderr, "\t--stream      Stream each trace from disk instead of loading\n");
+    fprintf(stderr, "\t               it, for traces larger than memory.\n");
+    fprintf(stderr, "\t--fused       Check correctness and utilization in one\n");
+    fprintf(stderr, "\t               replay of each trace instead of two.\n");
+    fprintf(stderr, "\t--series=<file> Write live, mapped and free bytes over\n");
+    fprintf(stderr, "\t               each trace to <file> as CSV.\n");
+    fprintf(stderr, "\t--frag=<n>    Snapshot the free blocks every <n> ops and at\n");
+    fprintf(stderr, "\t               peak live size, and report fragmentation.\n");
+    fprintf(stderr, "\t--layout[=<seed>] Map mm's pages at the same addresses in\n");
+    fprintf(stderr, "\t               every run, with noise pages placed by\n");
+    fprintf(stderr, "\t               <seed> (default %d), and turn off ASLR.\n",
+	    LAYOUT_SEED);
+    fprintf(stderr, "\t--layout-base=<addr> Start of the region (default %#lx).\n",
+	    LAYOUT_BASE);
+    fprintf(stderr, "Timing options\n");
+    fprintf(stderr, "\t--rigorous     Sample each trace until the 95%% CI is tight.\n");
+    fprintf(stderr, "\t--cpu=<n>      Pin the driver to CPU <n>.\n");
+    fprintf(stderr, "\t-j <n>         Evaluate up to <n> traces at once, in worker\n");
+    fprintf(stderr, "\t               processes pinned to their own CPUs.\n");
+    fprintf(stderr, "\t--serial-speed With -j, still time one trace at a time.\n");
+    fprintf(stderr, "\t--counters     Count CPU and OS events per op while replaying.\n");
+    fprintf(stderr, "\t--clock=<c>    Rigorous clock: raw (default) or tsc.\n");
+    fprintf(stderr, "\t--warmup=<n>   Untimed runs before sampling (default %d).\n",
+	    STATS_WARMUP);
+    fprintf(stderr, "\t--min-reps=<n> Fewest samples per trace (default %d).\n",
+	    STATS_MIN_REPS);
+    fprintf(stderr, "\t--max-reps=<n> Most samples per trace (default %d).\n",
+	    STATS_MAX_REPS);
+    fprintf(stderr, "\t--ci=<pct>     Target CI half-width, %% of mean (default %g).\n",
+	    STATS_TARGET_CI * 100.0);
 }
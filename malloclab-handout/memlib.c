@@ -9,6 +9,7 @@
 #include <string.h>
 #include <inttypes.h>
 #include <errno.h>
+#include <time.h>
 
 #include "memlib.h"
 #include "pagemap.h"
@@ -18,6 +19,33 @@ static int activity_counter = 0; /* to simulate other processes */
 
 static int page_count;
 
+/* the noise pages, which are unmapped by mem_reset */
+static void **noise_pages;
+static int noise_count, noise_max;
+
+static mem_stats_t stats;
+
+/* With a deterministic layout (mem_set_layout), mappings are placed
+   first-fit in [layout_lo, layout_hi), and each noise page is placed
+   up to NOISE_SPREAD pages past the first gap by a PRNG that restarts
+   from layout_seed at each mem_reset */
+static uintptr_t layout_lo, layout_hi;
+static unsigned layout_seed, noise_state;
+#define NOISE_SPREAD 16
+
+#ifndef MAP_FIXED_NOREPLACE
+#define MAP_FIXED_NOREPLACE 0x100000
+#endif
+
+/* seconds on the monotonic clock, for timing the system calls */
+static double now(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
 /* 
  * mem_init - initialize the memory system model
  */
@@ -31,9 +59,77 @@ void mem_init(void)
   }
 }
 
-static void unmap(void *p)
+/*
+ * mem_set_layout - place every later mapping at a fixed address in
+ *     [base, base+size), and draw the noise pages from seed, so that
+ *     each run of the same allocator sees the same addresses
+ */
+void mem_set_layout(void *base, size_t size, unsigned seed)
+{
+  layout_lo = (uintptr_t)base;
+  layout_hi = layout_lo + size;
+  if ((layout_lo & (APAGE_SIZE - 1)) || layout_hi <= layout_lo) {
+    fprintf(stderr, "mem_set_layout: bad region %p+%zu\n", base, size);
+    abort();
+  }
+  layout_seed = noise_state = seed ? seed : 1;
+}
+
+/* Should the next mem_map also map a noise page? At every power of 2
+   maps, with or without a layout */
+static int noise_due(void)
+{
+  return (activity_counter & (activity_counter - 1)) == 0;
+}
+
+/* How many pages past the first gap the next noise page goes */
+static size_t noise_skip(void)
+{
+  noise_state ^= noise_state << 13;
+  noise_state ^= noise_state >> 17;
+  noise_state ^= noise_state << 5;
+  return noise_state % NOISE_SPREAD;
+}
+
+/* mmap sz bytes, in the layout region if there is one, skip pages
+   past the first gap that fits */
+static void *map(size_t sz, size_t skip)
+{
+  uintptr_t a;
+  void *p;
+
+  if (!layout_hi)
+    return mmap(0, sz, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANON, -1, 0);
+
+  a = (uintptr_t)pagemap_find_gap((void *)layout_lo, sz) + skip * APAGE_SIZE;
+  for (;;) {
+    a = (uintptr_t)pagemap_find_gap((void *)a, sz);
+    if (a + sz > layout_hi) {
+      errno = ENOMEM;
+      return MAP_FAILED;
+    }
+    p = mmap((void *)a, sz, PROT_READ | PROT_WRITE,
+             MAP_PRIVATE | MAP_ANON | MAP_FIXED_NOREPLACE, -1, 0);
+    if (p == (void *)a)
+      return p;
+    if (p != MAP_FAILED) {
+      /* a kernel older than 4.17 took the address as a hint */
+      munmap(p, sz);
+      fprintf(stderr, "mem_map: MAP_FIXED_NOREPLACE is not supported\n");
+      abort();
+    }
+    if (errno != EEXIST)
+      return MAP_FAILED;
+    /* a noise page, or something else not in the pagemap, is there */
+    a += APAGE_SIZE;
+  }
+}
+
+/* unmap one run of pages; the pagemap merges the runs of adjacent
+   mappings, and a single munmap may span several mappings */
+static void unmap(void *p, size_t sz)
 {
-  if (munmap(p, APAGE_SIZE) < 0) {
+  if (munmap(p, sz) < 0) {
     fprintf(stderr, "unexpected error in munmap: %s (%d)\n",
             strerror(errno), errno);
     abort();
@@ -45,9 +141,12 @@ static void unmap(void *p)
  */
 void mem_reset(void)
 {
-  pagemap_for_each(unmap);
+  pagemap_for_each_range(unmap);
   page_count = 0;
+  while (noise_count > 0)
+    unmap(noise_pages[--noise_count], APAGE_SIZE);
   activity_counter = 0;
+  noise_state = layout_seed;
 }
 
 /*
@@ -63,11 +162,27 @@ size_t mem_heapsize(void)
   return APAGE_SIZE * page_count;
 }
 
+/*
+ * mem_get_stats - copy out the system call counts since they were
+ *     last cleared
+ */
+void mem_get_stats(mem_stats_t *s)
+{
+  *s = stats;
+}
+
+void mem_clear_stats(void)
+{
+  memset(&stats, 0, sizeof(stats));
+}
+
 
 void *mem_map(size_t sz)
 {
   void *p;
-  size_t i;
+  size_t pages;
+  double start;
+  int bin;
   
   if (sz & (APAGE_SIZE - 1)) {
     fprintf(stderr, "mem_map: requested size is not a multiple of %d: %ld\n",
@@ -76,23 +191,43 @@ void *mem_map(size_t sz)
   }
 
   activity_counter++;
-  if ((activity_counter & (activity_counter - 1)) == 0) {
+  if (noise_due()) {
     /* allocate a page to ensure that mem_map results are not
-       always sequential */
-    mmap(0, APAGE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANON, -1, 0);
+       always sequential, and remember it so that mem_reset can
+       free it */
+    if (noise_count == noise_max) {
+      noise_max = noise_max ? 2 * noise_max : 64;
+      if ((noise_pages = realloc(noise_pages, noise_max * sizeof(void *))) == NULL) {
+        fprintf(stderr, "mem_map: out of memory\n");
+        abort();
+      }
+    }
+    start = now();
+    p = map(APAGE_SIZE, layout_hi ? noise_skip() : 0);
+    stats.noise_secs += now() - start;
+    if (p != MAP_FAILED) {
+      noise_pages[noise_count++] = p;
+      stats.noise_maps++;
+    }
   }
 
-  p = mmap(0, sz, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANON, -1, 0);
+  start = now();
+  p = map(sz, 0);
+  stats.map_secs += now() - start;
   if (p == MAP_FAILED) {
     fprintf(stderr, "mmap failed: %s (%d)\n",
             strerror(errno), errno);
     abort();
   }
+  stats.maps++;
+  stats.map_bytes += sz;
+  pages = sz / APAGE_SIZE;
+  for (bin = 0; bin < MEM_SIZE_BINS - 1 && (pages >> (bin + 1)) != 0; bin++)
+    ;
+  stats.map_hist[bin]++;
 
-  for (i = 0; i < sz; i += APAGE_SIZE) {
-    pagemap_modify(p + i, 1);
-    page_count++;
-  }
+  pagemap_modify_range(p, sz, 1);
+  page_count += sz / APAGE_SIZE;
   
   return p;
 }
@@ -100,6 +235,7 @@ void *mem_map(size_t sz)
 void mem_unmap(void *p, size_t sz)
 {
   size_t i;
+  double start;
   
   if (((uintptr_t)p) & (APAGE_SIZE - 1)) {
     fprintf(stderr, "mem_unmap: given address is not page-aligned: %p\n",
@@ -113,21 +249,25 @@ void mem_unmap(void *p, size_t sz)
     abort();
   }
   
-  for (i = 0; i < sz; i += APAGE_SIZE) {
-    if (!pagemap_is_mapped(p+i)) {
-      fprintf(stderr, "mem_unmap: given page is not mapped: %p (in %p:%p)\n",
-              p + i, p, p + sz);
-      abort();
-    }      
-
-    pagemap_modify(p + i, 0);
-    
-    --page_count;
+  if (!pagemap_range_is_mapped(p, sz)) {
+    /* find the culprit, which is only worth doing page by page now */
+    for (i = 0; i < sz && pagemap_is_mapped(p+i); i += APAGE_SIZE)
+      ;
+    fprintf(stderr, "mem_unmap: given page is not mapped: %p (in %p:%p)\n",
+            p + i, p, p + sz);
+    abort();
   }
 
+  pagemap_modify_range(p, sz, 0);
+  page_count -= sz / APAGE_SIZE;
+
+  start = now();
   if (munmap(p, sz) < 0) {
     fprintf(stderr, "munmap failed: %s (%d)\n",
             strerror(errno), errno);
     abort();
   }
+  stats.unmap_secs += now() - start;
+  stats.unmaps++;
+  stats.unmap_bytes += sz;
 }
@@ -1,3 +1,6 @@
+#ifndef __MEMLIB_H_
+#define __MEMLIB_H_
+
 #include <unistd.h>
 
 void mem_init(void);               
@@ -8,3 +11,28 @@ void *mem_map(size_t);
 void mem_unmap(void *, size_t);
 
 size_t mem_heapsize(void);
+
+/* Place mappings at fixed addresses in [base, base+size), with noise
+   pages placed by seed, for run-to-run reproducible layouts */
+void mem_set_layout(void *base, size_t size, unsigned seed);
+
+/* Counts of the system calls made for mem_map and mem_unmap */
+#define MEM_SIZE_BINS 24   /* mappings by power-of-2 number of pages */
+
+typedef struct {
+  unsigned long maps;           /* mmap calls made by mem_map */
+  unsigned long unmaps;         /* munmap calls made by mem_unmap */
+  unsigned long long map_bytes;
+  unsigned long long unmap_bytes;
+  double map_secs;              /* time spent in those calls */
+  double unmap_secs;
+  unsigned long map_hist[MEM_SIZE_BINS]; /* mappings of [2^i, 2^(i+1)) pages */
+  unsigned long noise_maps;     /* extra pages mapped to simulate other
+                                   processes, which are not heap */
+  double noise_secs;
+} mem_stats_t;
+
+void mem_get_stats(mem_stats_t *s);
+void mem_clear_stats(void);
+
+#endif /* __MEMLIB_H_ */
@@ -24,10 +24,105 @@
 #include <assert.h>
 #include <unistd.h>
 #include <string.h>
+#include <stddef.h>
 
 #include "mm.h"
 #include "memlib.h"
 
+#ifdef MM_PROFILE
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define CYCLES() __rdtsc()
+#else
+#include <time.h>
+static unsigned long long CYCLES(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+#endif
+static mm_phases_t phases;
+// Bracket a phase of mm_malloc or mm_free; with MM_PROFILE off, nothing
+#define PHASE_BEGIN(ph) unsigned long long ph##_start = CYCLES()
+#define PHASE_END(ph) (phases.cycles[ph] += CYCLES() - ph##_start, phases.calls[ph]++)
+#else
+#define PHASE_BEGIN(ph)
+#define PHASE_END(ph)
+#endif
+
+#ifdef MM_EVLOG
+#include "evlog.h"
+// Log an event to the per-thread ring; with MM_EVLOG off, nothing
+#define EVENT(kind, addr, size, block, visits) \
+  evlog_record(kind, addr, size, block, visits)
+// Open the log before the driver forks any workers
+static void __attribute__((constructor)) open_evlog(void) {
+  evlog_open();
+}
+#else
+#define EVENT(kind, addr, size, block, visits)
+#endif
+
+#ifdef MM_HEAPPROF
+#include "heapprof.h"
+// Count the bytes down to the next sample, and mark a sampled block
+// in its header so that only its free needs to look it up
+#define SAMPLE_MALLOC(bp, size) do { \
+    if ((heapprof_countdown -= (size)) < 0 && heapprof_sample(bp, size)) \
+      PUT(HDRP(bp), GET(HDRP(bp)) | SAMPLED); \
+  } while (0)
+#define SAMPLE_FREE(bp) do { \
+    if (GET(HDRP(bp)) & SAMPLED) \
+      heapprof_free(bp); \
+  } while (0)
+#define SAMPLE_RESET() heapprof_reset()
+#else
+#define SAMPLE_MALLOC(bp, size)
+#define SAMPLE_FREE(bp)
+#define SAMPLE_RESET()
+#endif
+
+// The running totals behind mm_get_stats, as signed deltas. Under
+// MM_THREADED each thread adds to its own cells and mm_get_stats sums
+// them; a block freed by another thread than the one that allocated it
+// leaves one thread's alloc_bytes negative, and only the sum means
+// anything. The cells up to mallocs describe the current heap.
+typedef struct stat_cells {
+  long long mapped_bytes, chunks, alloc_bytes, alloc_blocks;
+  long long free_bytes, free_blocks;
+  long long band_bytes[MM_FREE_BANDS], band_blocks[MM_FREE_BANDS];
+  long long mallocs, frees, mmaps, munmaps;
+  struct stat_cells* next;
+} stat_cells;
+
+#define CELLS(c)   ((long long*)(c))
+#define HEAP_CELLS (offsetof(stat_cells, mallocs) / sizeof(long long))
+#define ALL_CELLS  (offsetof(stat_cells, next) / sizeof(long long))
+
+#ifdef MM_THREADED
+#include <pthread.h>
+static __thread stat_cells my_cells;
+static __thread int my_cells_listed;
+static stat_cells* all_cells;  // the cells of every thread that has any
+static stat_cells retired;     // what the threads that exited left
+static stat_cells heap_base;   // the sums when mm_init last ran
+static pthread_mutex_t cells_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_key_t cells_key;
+static pthread_once_t cells_once = PTHREAD_ONCE_INIT;
+static void list_cells(void);
+static void sum_cells(stat_cells* sum);
+// A thread only writes its own cells, but mm_get_stats may read them
+// meanwhile, so the stores are atomic (and as cheap as plain ones)
+#define STAT(field, d) do { \
+    if (!my_cells_listed) \
+      list_cells(); \
+    __atomic_store_n(&my_cells.field, my_cells.field + (d), __ATOMIC_RELAXED); \
+  } while (0)
+#else
+static stat_cells cells;
+#define STAT(field, d) (cells.field += (d))
+#endif
+
 /* always use 16-byte alignment */
 #define ALIGNMENT 16
 
@@ -64,6 +159,9 @@
 // Combine a size and alloc bit
 #define PACK(size, alloc) ((size) | (alloc))
 
+// Set in the header of an allocated block that the heap profiler sampled
+#define SAMPLED 0x2
+
 // Given a header pionter, get the alloc or size
 #define GET_ALLOC(p) (GET(p) & 0x1)
 #define GET_SIZE(p)  (GET(p) & ~0xF)
@@ -78,6 +176,10 @@ typedef struct list_node{
 
 struct list_node* list_head;
 size_t initial_mapped;
+void* chunk_list; // mapped chunks, linked through their padding words
+
+static mm_counts_t counts;
+static unsigned long last_visits; // free blocks the last find_fit looked at
 
 static void* coalesce(void* bp);
 static void* extend(size_t s);
@@ -85,12 +187,20 @@ static void add_node(void* bp);
 static void delete_node(void* bp);
 static void* find_fit(size_t asize);
 static void set_allocated(void* bp, size_t size);
+static void remove_chunk(void* chunk);
+static void stat_free(size_t size, int sign);
+static void stat_clear_heap(void);
 
 /* 
  * mm_init - initialize the malloc package.
  */
 int mm_init(void){
   list_head = NULL;
+  chunk_list = NULL;
+  initial_mapped = 0;  // chunk sizes grow from scratch on each new heap
+  stat_clear_heap();
+  EVENT(EV_INIT, NULL, 0, 0, 0);
+  SAMPLE_RESET();
   return 0;
 }
 
@@ -105,13 +215,25 @@ void* mm_malloc(size_t size)
   void* free_block = NULL;   
   
   // check our free_list to see if we have a block on the current page to allocate
-  if((free_block = find_fit(full_size)) != NULL) 
-    set_allocated(free_block, full_size);
-  else {
-    if((free_block = extend(full_size)) != NULL) {
+  PHASE_BEGIN(MM_PHASE_FIND_FIT);
+  free_block = find_fit(full_size);
+  PHASE_END(MM_PHASE_FIND_FIT);
+  if(free_block == NULL) {
+    PHASE_BEGIN(MM_PHASE_EXTEND);
+    free_block = extend(full_size);
+    PHASE_END(MM_PHASE_EXTEND);
+    if(free_block != NULL)
       free_block = list_head;
-      set_allocated(free_block, full_size);
-    }
+  }
+  if(free_block != NULL) {
+    PHASE_BEGIN(MM_PHASE_SPLIT);
+    set_allocated(free_block, full_size);
+    PHASE_END(MM_PHASE_SPLIT);
+    STAT(mallocs, 1);
+    STAT(alloc_bytes, GET_SIZE(HDRP(free_block)));
+    STAT(alloc_blocks, 1);
+    EVENT(EV_MALLOC, free_block, size, GET_SIZE(HDRP(free_block)), last_visits);
+    SAMPLE_MALLOC(free_block, size);
   }
   return free_block;
 }
@@ -124,20 +246,252 @@ void mm_free(void* ptr)
   void* pointer;
   
   size_t size = GET_SIZE(HDRP(ptr));
+  EVENT(EV_FREE, ptr, 0, size, 0);
+  STAT(frees, 1);
+  STAT(alloc_bytes, -(long long)size);
+  STAT(alloc_blocks, -1);
+  SAMPLE_FREE(ptr);
   PUT(HDRP(ptr), PACK(size, 0));
   PUT(FTRP(ptr), PACK(size, 0));
+  PHASE_BEGIN(MM_PHASE_COALESCE);
   pointer = coalesce(ptr);
+  PHASE_END(MM_PHASE_COALESCE);
 
   // get existing size
   if(((GET_SIZE(pointer - 24)) == OVERHEAD) && ((GET_SIZE(FTRP(pointer) + 8) == 0))) {
     if(GET_SIZE(HDRP(pointer)) >= (4096*10)){
+      PHASE_BEGIN(MM_PHASE_UNMAP);
       delete_node(pointer);
       size_t map_size = GET_SIZE(HDRP(pointer)) + PAGE_OVERHEAD;
+      remove_chunk(pointer-PAGE_OVERHEAD);
       mem_unmap(pointer-PAGE_OVERHEAD, map_size);
+      counts.unmaps++;
+      STAT(munmaps, 1);
+      STAT(mapped_bytes, -(long long)map_size);
+      STAT(chunks, -1);
+      EVENT(EV_UNMAP, pointer-PAGE_OVERHEAD, map_size, 0, 0);
+      PHASE_END(MM_PHASE_UNMAP);
+    }
+  }
+}
+
+/*
+ * mm_free_bytes - The total size of the blocks on the free list, for
+ *     the driver's heap time series.
+ */
+size_t mm_free_bytes(void)
+{
+  struct mm_stats stats;
+
+  mm_get_stats(&stats);
+  return stats.free_bytes;
+}
+
+/*
+ * mm_heapinfo - Describe the free blocks and the chunks of the heap,
+ *     for the driver's fragmentation snapshots. Walks every block.
+ */
+void mm_heapinfo(mm_heapinfo_t *info)
+{
+  struct list_node* current;
+  void* chunk;
+  void* bp;
+  size_t size, chunk_size, used;
+  int bin;
+
+  memset(info, 0, sizeof(*info));
+
+  for (current = list_head; current != NULL; current = current->next) {
+    size = GET_SIZE(HDRP(current));
+    info->free_blocks++;
+    info->free_bytes += size;
+    if (size > info->largest_free)
+      info->largest_free = size;
+    for (bin = 0; bin < MM_SIZE_BINS - 1 && (size >> (bin + 1)) != 0; bin++)
+      ;
+    info->free_hist[bin]++;
+  }
+
+  for (chunk = chunk_list; chunk != NULL; chunk = (void*)GET(chunk)) {
+    chunk_size = PAGE_OVERHEAD;
+    used = 0;
+    for (bp = chunk + PAGE_OVERHEAD; GET_SIZE(HDRP(bp)) != 0; bp = NEXT_BLKP(bp)) {
+      chunk_size += GET_SIZE(HDRP(bp));
+      if (GET_ALLOC(HDRP(bp)))
+        used += GET_SIZE(HDRP(bp));
     }
+    info->chunks++;
+    info->chunk_bytes += chunk_size;
+    bin = used * MM_OCC_BINS / chunk_size;
+    info->chunk_occ[bin < MM_OCC_BINS ? bin : MM_OCC_BINS - 1]++;
   }
 }
 
+/*
+ * mm_phase_get - Copy out the cycles and calls of each phase since
+ *     mm_phase_clear. Returns 0, with all zeros, unless mm.c was built
+ *     with MM_PROFILE.
+ */
+int mm_phase_get(mm_phases_t *p)
+{
+#ifdef MM_PROFILE
+  *p = phases;
+  return 1;
+#else
+  memset(p, 0, sizeof(*p));
+  return 0;
+#endif
+}
+
+void mm_phase_clear(void)
+{
+#ifdef MM_PROFILE
+  memset(&phases, 0, sizeof(phases));
+#endif
+}
+
+/*
+ * mm_counts_get - Copy out the search and reshaping counts since
+ *     mm_counts_clear
+ */
+void mm_counts_get(mm_counts_t *c)
+{
+  *c = counts;
+}
+
+void mm_counts_clear(void)
+{
+  memset(&counts, 0, sizeof(counts));
+}
+
+/*
+ * mm_get_stats - Copy out the running totals. Costs the same however
+ *     big the heap is; under MM_THREADED, it sums the cells of each
+ *     thread that has used the allocator.
+ */
+void mm_get_stats(struct mm_stats* s)
+{
+  stat_cells sum;
+  int i;
+
+#ifdef MM_THREADED
+  size_t j;
+
+  pthread_mutex_lock(&cells_lock);
+  sum_cells(&sum);
+  for (j = 0; j < HEAP_CELLS; j++)
+    CELLS(&sum)[j] -= CELLS(&heap_base)[j];
+  pthread_mutex_unlock(&cells_lock);
+#else
+  sum = cells;
+#endif
+
+  s->mapped_bytes = sum.mapped_bytes;
+  s->chunks = sum.chunks;
+  s->alloc_bytes = sum.alloc_bytes;
+  s->alloc_blocks = sum.alloc_blocks;
+  s->free_bytes = sum.free_bytes;
+  s->free_blocks = sum.free_blocks;
+  for (i = 0; i < MM_FREE_BANDS; i++) {
+    s->band_bytes[i] = sum.band_bytes[i];
+    s->band_blocks[i] = sum.band_blocks[i];
+  }
+  s->mallocs = sum.mallocs;
+  s->frees = sum.frees;
+  s->mmaps = sum.mmaps;
+  s->munmaps = sum.munmaps;
+}
+
+#ifdef MM_THREADED
+/*
+ * Add up every thread's cells and the retired ones; cells_lock is held
+ */
+static void sum_cells(stat_cells* sum) {
+  stat_cells* c;
+  size_t j;
+
+  *sum = retired;
+  for (c = all_cells; c != NULL; c = c->next)
+    for (j = 0; j < ALL_CELLS; j++)
+      CELLS(sum)[j] += __atomic_load_n(&CELLS(c)[j], __ATOMIC_RELAXED);
+}
+
+/*
+ * A thread is exiting: fold its cells into retired and unlist them
+ */
+static void retire_cells(void* p) {
+  stat_cells* c = p;
+  stat_cells** link;
+  size_t j;
+
+  pthread_mutex_lock(&cells_lock);
+  for (j = 0; j < ALL_CELLS; j++)
+    CELLS(&retired)[j] += CELLS(c)[j];
+  for (link = &all_cells; *link != c; link = &(*link)->next)
+    ;
+  *link = c->next;
+  pthread_mutex_unlock(&cells_lock);
+}
+
+static void make_cells_key(void) {
+  pthread_key_create(&cells_key, retire_cells);
+}
+
+/*
+ * The calling thread's first update: list its cells for mm_get_stats
+ */
+static void list_cells(void) {
+  pthread_once(&cells_once, make_cells_key);
+  pthread_mutex_lock(&cells_lock);
+  my_cells.next = all_cells;
+  all_cells = &my_cells;
+  pthread_mutex_unlock(&cells_lock);
+  pthread_setspecific(cells_key, &my_cells);
+  my_cells_listed = 1;
+}
+#endif
+
+/*
+ * The band of mm_stats that a free block of size bytes counts in
+ */
+static inline int free_band(size_t size) {
+  int lg = 63 - __builtin_clzl(size | 1);
+  int band = lg < 6 ? 0 : (lg - 4) / 2;
+
+  return band < MM_FREE_BANDS ? band : MM_FREE_BANDS - 1;
+}
+
+/*
+ * Count a free block of size bytes in (sign 1) or out (sign -1)
+ */
+static void stat_free(size_t size, int sign) {
+  int band = free_band(size);
+
+  STAT(free_bytes, sign * (long long)size);
+  STAT(free_blocks, sign);
+  STAT(band_bytes[band], sign * (long long)size);
+  STAT(band_blocks[band], sign);
+}
+
+/*
+ * mm_init starts a new heap: the totals that describe the old one
+ *     start again from zero. Under MM_THREADED the other threads' cells
+ *     are left alone, since only their owners write them; the current
+ *     sums become the zero point that mm_get_stats subtracts.
+ */
+static void stat_clear_heap(void) {
+#ifdef MM_THREADED
+  pthread_mutex_lock(&cells_lock);
+  sum_cells(&heap_base);
+  pthread_mutex_unlock(&cells_lock);
+#else
+  size_t j;
+
+  for (j = 0; j < HEAP_CELLS; j++)
+    CELLS(&cells)[j] = 0;
+#endif
+}
+
 // ******Recommended helper functions******
 /* These functios will provide a high-level recommended structure to your program.
  * Fill them in as needed, and create additional helper functions depending on your design.
@@ -154,6 +508,7 @@ static void set_allocated(void* bp, size_t size) {
   delete_node(bp);
   // split
   if(difference > PAGE_OVERHEAD) {
+    counts.splits++;
     PUT(HDRP(bp), PACK(size, 1));
     PUT(FTRP(bp), PACK(size, 1));
     PUT(HDRP(NEXT_BLKP(bp)), PACK(difference, 0));
@@ -190,9 +545,15 @@ static void* extend(size_t s) {
   size = PAGE_ALIGN(size + PAGE_OVERHEAD);
   
   void* bp = mem_map(size);
+  counts.extends++;
+  STAT(mmaps, 1);
+  STAT(mapped_bytes, size);
+  STAT(chunks, 1);
+  EVENT(EV_MAP, bp, size, 0, 0);
     // return NULL;
   
-  PUT(bp, 0);                                  // padding
+  PUT(bp, (size_t)chunk_list);                 // padding, links the chunks
+  chunk_list = bp;
   bp +=8;
   PUT(bp, PACK(16, 1));                          // header sentinel
   bp +=8;
@@ -208,6 +569,17 @@ static void* extend(size_t s) {
   return bp;
 }
 
+/*
+ * Unlink a chunk that is about to be unmapped from the chunk list
+ */
+static void remove_chunk(void* chunk) {
+  void** link = &chunk_list;
+
+  while (*link != chunk)
+    link = (void**)*link;
+  *link = (void*)GET(chunk);
+}
+
 /*
  * Coalesce a free block if applicable
  * Returns pointer to new coalesced block
@@ -218,6 +590,8 @@ static void* coalesce(void* bp) {
   size_t next_alloc = GET_ALLOC(HDRP(NEXT_BLKP(bp)));
   size_t size = GET_SIZE(HDRP(bp));
 
+  counts.coalesce[(prev_alloc ? 0 : 2) + (next_alloc ? 0 : 1)]++;
+
   if (prev_alloc && next_alloc)
     add_node(bp);
 
@@ -229,14 +603,18 @@ static void* coalesce(void* bp) {
     add_node(bp);
   }
   else if (!prev_alloc && next_alloc) {
+    stat_free(GET_SIZE(HDRP(PREV_BLKP(bp))), -1);
     size += GET_SIZE(HDRP(PREV_BLKP(bp)));
+    stat_free(size, 1);
     PUT(HDRP(PREV_BLKP(bp)), PACK(size, 0));
     PUT(FTRP(bp), PACK(size, 0));
     bp = PREV_BLKP(bp);
   }
   else {
+    stat_free(GET_SIZE(HDRP(PREV_BLKP(bp))), -1);
     size += GET_SIZE(HDRP(NEXT_BLKP(bp))) + GET_SIZE(HDRP(PREV_BLKP(bp)));
     delete_node(NEXT_BLKP(bp));
+    stat_free(size, 1);
     PUT(HDRP(PREV_BLKP(bp)), PACK(size, 0));
     PUT(FTRP(NEXT_BLKP(bp)), PACK(size, 0));
     bp = PREV_BLKP(bp);
@@ -256,6 +634,7 @@ static void add_node(void* bp) {
 
   list_node* new_node = (list_node*)bp;
 
+  stat_free(GET_SIZE(HDRP(bp)), 1);
   new_node->next = list_head;
   if(list_head != NULL)
     list_head->prev = new_node;
@@ -266,6 +645,7 @@ static void add_node(void* bp) {
 static void delete_node(void* bp) {
   list_node* current_node = (list_node*)bp;
   
+  stat_free(GET_SIZE(HDRP(bp)), -1);
   if(current_node->prev == NULL) {
     if(current_node->next == NULL)
       list_head = NULL;
@@ -287,12 +667,24 @@ static void delete_node(void* bp) {
 
 static void *find_fit(size_t asize) {
   struct list_node* current = list_head;
+  unsigned long visited = 0;
+  int bin;
 
   while (current) {
+    visited++;
     if (GET_SIZE(HDRP(current)) >= asize)
-      return (void*)current;
+      break;
     else
       current = current->next;
   }
-  return NULL;
+
+  last_visits = visited;
+  counts.searches++;
+  counts.visited += visited;
+  if (current == NULL)
+    counts.misses++;
+  for (bin = 0; bin < MM_SEARCH_BINS - 1 && (visited >> bin) != 0; bin++)
+    ;
+  counts.search_hist[bin]++;
+  return (void*)current;
 }
@@ -1,5 +1,94 @@
+#ifndef __MM_H_
+#define __MM_H_
+
 #include <stdio.h>
 
+/* A snapshot of the free blocks and chunks of the heap (mm_heapinfo) */
+#define MM_SIZE_BINS 32  /* free blocks by power-of-2 size class */
+#define MM_OCC_BINS  10  /* chunks by tenths of occupancy */
+
+typedef struct {
+  size_t free_blocks;               /* number of free blocks */
+  size_t free_bytes;                /* their total size */
+  size_t largest_free;              /* the size of the largest one */
+  size_t free_hist[MM_SIZE_BINS];   /* free blocks of [2^i, 2^(i+1)) bytes */
+  size_t chunks;                    /* number of mapped chunks */
+  size_t chunk_bytes;               /* their total size */
+  size_t chunk_occ[MM_OCC_BINS];    /* chunks that are [i/10, (i+1)/10)
+                                       allocated, the last bin including 1 */
+} mm_heapinfo_t;
+
+/* Cycles spent in each phase of mm_malloc and mm_free, and how often
+   each ran. Counted only when mm.c is built with -DMM_PROFILE (make
+   PROFILE=1); otherwise the hooks compile to nothing. */
+enum {
+  MM_PHASE_FIND_FIT,    /* searching the free list */
+  MM_PHASE_SPLIT,       /* set_allocated, splitting off the remainder */
+  MM_PHASE_COALESCE,    /* merging a freed block with its neighbors */
+  MM_PHASE_EXTEND,      /* mapping and setting up a new chunk */
+  MM_PHASE_UNMAP,       /* giving an empty chunk back */
+  MM_NPHASES
+};
+
+typedef struct {
+  unsigned long long cycles[MM_NPHASES];
+  unsigned long long calls[MM_NPHASES];
+} mm_phases_t;
+
+/* How the free list is searched and the heap reshaped, counted always
+   (mm_counts_get) */
+#define MM_SEARCH_BINS 20  /* searches by free blocks visited: none, then
+                              [2^(i-1), 2^i) for bin i */
+enum { MM_COALESCE_NONE, MM_COALESCE_NEXT, MM_COALESCE_PREV,
+       MM_COALESCE_BOTH, MM_COALESCE_CASES };
+
+typedef struct {
+  unsigned long long searches;      /* find_fit calls */
+  unsigned long long visited;       /* free blocks they looked at */
+  unsigned long long misses;        /* searches that found no fit */
+  unsigned long long search_hist[MM_SEARCH_BINS];
+  unsigned long long splits;        /* allocations that split a block */
+  unsigned long long coalesce[MM_COALESCE_CASES]; /* frees by which
+                                       neighbors were free to merge */
+  unsigned long long extends;       /* new chunks mapped */
+  unsigned long long unmaps;        /* empty chunks given back */
+} mm_counts_t;
+
+/* The allocator's own running totals (mm_get_stats), in the spirit of
+   mallinfo2. They are kept up to date by mm_malloc and mm_free, so that
+   reading them is cheap and never walks the heap. The byte and block
+   counts describe the current heap; the op and syscall counts run on
+   across mm_init. */
+#define MM_FREE_BANDS 8  /* free blocks by size: [0, 64) bytes, then
+                            [64 * 4^(i-1), 64 * 4^i) for band i, the
+                            last band including everything larger */
+
+struct mm_stats {
+  size_t mapped_bytes;              /* bytes in mapped chunks */
+  size_t chunks;                    /* number of mapped chunks */
+  size_t alloc_bytes;               /* bytes in allocated blocks, with
+                                       their headers, footers and
+                                       padding; not the payload asked for */
+  size_t alloc_blocks;              /* number of allocated blocks */
+  size_t free_bytes;                /* bytes in free blocks */
+  size_t free_blocks;               /* number of free blocks */
+  size_t band_bytes[MM_FREE_BANDS]; /* free bytes, by size band */
+  size_t band_blocks[MM_FREE_BANDS];/* free blocks, by size band */
+  unsigned long long mallocs;       /* mm_malloc calls that succeeded */
+  unsigned long long frees;         /* mm_free calls */
+  unsigned long long mmaps;         /* mem_map calls */
+  unsigned long long munmaps;       /* mem_unmap calls */
+};
+
 extern int mm_init (void);
 extern void *mm_malloc (size_t size);
 extern void mm_free (void *ptr);
+extern size_t mm_free_bytes (void);
+extern void mm_heapinfo (mm_heapinfo_t *info);
+extern int mm_phase_get (mm_phases_t *phases);
+extern void mm_phase_clear (void);
+extern void mm_counts_get (mm_counts_t *counts);
+extern void mm_counts_clear (void);
+extern void mm_get_stats (struct mm_stats *stats);
+
+#endif /* __MM_H_ */
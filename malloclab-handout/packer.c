@@ -0,0 +1,290 @@
+/*
+ * packer.c - How much heap does a trace really need?
+ *
+ * Usage: packer [-a <align>] [-m <min>] [-t <dir>] [<file>...]
+ *
+ * mdriver scores utilization against the peak live payload, which no
+ * allocator can reach once payloads are rounded up and blocks are
+ * freed out of order. For each trace, packer works out the heap of an
+ * allocator that knows every future free:
+ *
+ *   lower   the peak of the live blocks, each rounded up to <align>
+ *           bytes and to at least <min> bytes. No placement can use
+ *           less.
+ *   packed  the heap of an actual placement: blocks are placed
+ *           offline, largest first, at the lowest address that is
+ *           free for the whole of their lifetime. Some allocator can
+ *           achieve this, so the best possible heap lies between
+ *           lower and packed.
+ *
+ * It then replays the trace through mm.c, as mdriver's utilization
+ * pass does, and reports how far mm's peak heap is above both.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "mm.h"
+#include "memlib.h"
+#include "trace.h"
+#include "config.h"
+
+/* The lifetime of one block, as ops [start, end), and its place */
+typedef struct {
+    int start;
+    int end;
+    size_t size;         /* rounded size */
+    size_t offset;       /* address in the packed heap */
+} block_t;
+
+static size_t align = ALIGNMENT;  /* blocks are a multiple of this... */
+static size_t min_block = ALIGNMENT; /* ... and at least this big */
+
+static char *default_tracefiles[] = {
+    DEFAULT_TRACEFILES, NULL
+};
+
+static void usage(void)
+{
+    fprintf(stderr, "Usage: packer [-a <align>] [-m <min>] [-t <dir>] "
+	    "[<file>...]\n");
+    fprintf(stderr, "\t-a <align>  Round blocks up to <align> bytes "
+	    "(default %d).\n", ALIGNMENT);
+    fprintf(stderr, "\t-m <min>    Smallest block in bytes (default %d).\n",
+	    ALIGNMENT);
+    fprintf(stderr, "\t-t <dir>    Directory of the default traces.\n");
+    exit(1);
+}
+
+static void *xmalloc(size_t n)
+{
+    void *p;
+
+    if ((p = malloc(n)) == NULL) {
+	perror("packer");
+	exit(1);
+    }
+    return p;
+}
+
+/* the space a block of size payload bytes takes in the packed heap */
+static size_t rounded(int size)
+{
+    size_t s = ((size_t)size + align - 1) / align * align;
+
+    return (s < min_block) ? min_block : s;
+}
+
+/*
+ * lifetimes - Turn the ops of a trace into blocks with lifetimes.
+ *     A realloc ends the old block and starts a new one at the same
+ *     op, so the two may share space. Return the number of blocks.
+ */
+static int lifetimes(trace_t *trace, block_t **blocksp)
+{
+    block_t *blocks = xmalloc((trace->num_ops + 1) * sizeof(block_t));
+    int *live = xmalloc((trace->num_ids + 1) * sizeof(int));
+    int i, n = 0, id;
+
+    for (i = 0; i <= trace->num_ids; i++)
+	live[i] = -1;
+    for (i = 0; i < trace->num_ops; i++) {
+	id = trace->ops[i].index;
+	if (trace->ops[i].type != ALLOC && live[id] >= 0) {
+	    blocks[live[id]].end = i;
+	    live[id] = -1;
+	}
+	if (trace->ops[i].type != FREE) {
+	    blocks[n].start = i;
+	    blocks[n].end = trace->num_ops;  /* never freed */
+	    blocks[n].size = rounded(trace->ops[i].size);
+	    live[id] = n++;
+	}
+    }
+    free(live);
+    *blocksp = blocks;
+    return n;
+}
+
+/*
+ * lower_bound - The peak total size of the blocks that are live after
+ *     any op
+ */
+static size_t lower_bound(trace_t *trace, block_t *blocks, int n)
+{
+    long long *delta = xmalloc((trace->num_ops + 1) * sizeof(long long));
+    long long live = 0, peak = 0;
+    int i;
+
+    memset(delta, 0, (trace->num_ops + 1) * sizeof(long long));
+    for (i = 0; i < n; i++) {
+	delta[blocks[i].start] += blocks[i].size;
+	delta[blocks[i].end] -= blocks[i].size;
+    }
+    for (i = 0; i < trace->num_ops; i++) {
+	live += delta[i];
+	if (live > peak)
+	    peak = live;
+    }
+    free(delta);
+    return peak;
+}
+
+/* largest blocks first, then earliest */
+static int by_size(const void *a, const void *b)
+{
+    const block_t *x = a, *y = b;
+
+    if (x->size != y->size)
+	return (x->size < y->size) ? 1 : -1;
+    return x->start - y->start;
+}
+
+/* lowest offset first */
+static int by_offset(const void *a, const void *b)
+{
+    const block_t *x = *(block_t * const *)a, *y = *(block_t * const *)b;
+
+    return (x->offset > y->offset) - (x->offset < y->offset);
+}
+
+/*
+ * pack - Place the blocks, largest first, each at the lowest offset
+ *     that does not overlap a block placed before it whose lifetime
+ *     overlaps its own. Return the size of the heap. O(n^2) time.
+ */
+static size_t pack(block_t *blocks, int n)
+{
+    block_t **conflicts = xmalloc(n * sizeof(block_t *));
+    block_t *b;
+    size_t offset, heap = 0;
+    int i, j, nc;
+
+    qsort(blocks, n, sizeof(block_t), by_size);
+    for (i = 0; i < n; i++) {
+	b = &blocks[i];
+	nc = 0;
+	for (j = 0; j < i; j++)
+	    if (blocks[j].start < b->end && b->start < blocks[j].end)
+		conflicts[nc++] = &blocks[j];
+	qsort(conflicts, nc, sizeof(block_t *), by_offset);
+
+	offset = 0;
+	for (j = 0; j < nc; j++) {
+	    if (conflicts[j]->offset >= offset + b->size)
+		break;  /* fits in the gap below this one */
+	    if (conflicts[j]->offset + conflicts[j]->size > offset)
+		offset = conflicts[j]->offset + conflicts[j]->size;
+	}
+	b->offset = offset;
+	if (offset + b->size > heap)
+	    heap = offset + b->size;
+    }
+    free(conflicts);
+    return heap;
+}
+
+/*
+ * mm_peak - Replay the trace through mm.c the way mdriver's utilization
+ *     pass does, with realloc as malloc and free, and return the peak
+ *     heap size and, in *live, the peak live payload
+ */
+static size_t mm_peak(trace_t *trace, size_t *live)
+{
+    size_t total = 0, heap, peak = 0;
+    int i, id, size;
+    char *p;
+
+    *live = 0;
+    if (mm_init() < 0) {
+	fprintf(stderr, "packer: mm_init failed\n");
+	exit(1);
+    }
+    for (i = 0; i < trace->num_ops; i++) {
+	id = trace->ops[i].index;
+	size = trace->ops[i].size;
+	switch (trace->ops[i].type) {
+	case ALLOC:
+	case REALLOC:
+	    if ((p = mm_malloc(size)) == NULL) {
+		fprintf(stderr, "packer: mm_malloc failed at op %d\n", i);
+		exit(1);
+	    }
+	    if (trace->ops[i].type == REALLOC) {
+		mm_free(trace->blocks[id]);
+		total -= trace->block_sizes[id];
+	    }
+	    trace->blocks[id] = p;
+	    trace->block_sizes[id] = size;
+	    total += size;
+	    break;
+	case FREE:
+	    mm_free(trace->blocks[id]);
+	    total -= trace->block_sizes[id];
+	    break;
+	}
+	if (total > *live)
+	    *live = total;
+	if ((heap = mem_heapsize()) > peak)
+	    peak = heap;
+    }
+    mem_reset();
+    return peak;
+}
+
+int main(int argc, char **argv)
+{
+    char tracedir[1024] = TRACEDIR;
+    char **tracefiles = default_tracefiles;
+    trace_t *trace;
+    block_t *blocks;
+    size_t live, lower, packed, mm;
+    int c, i, n;
+
+    while ((c = getopt(argc, argv, "a:m:t:h")) != EOF) {
+	switch (c) {
+	case 'a':
+	    align = atoi(optarg);
+	    break;
+	case 'm':
+	    min_block = atoi(optarg);
+	    break;
+	case 't':
+	    snprintf(tracedir, sizeof(tracedir), "%s%s", optarg,
+		     optarg[strlen(optarg)-1] == '/' ? "" : "/");
+	    break;
+	default:
+	    usage();
+	}
+    }
+    if (align == 0)
+	usage();
+    if (optind < argc) {
+	tracefiles = &argv[optind];
+	strcpy(tracedir, "./");
+    }
+
+    mem_init();
+    printf("%-20s %8s %10s %10s %10s %10s %6s %6s %6s\n", "trace", "ops",
+	   "live", "lower", "packed", "mm", "util", "best", "gap");
+    for (i = 0; tracefiles[i] != NULL; i++) {
+	trace = read_trace(tracedir, tracefiles[i]);
+	n = lifetimes(trace, &blocks);
+	lower = lower_bound(trace, blocks, n);
+	packed = pack(blocks, n);
+	mm = mm_peak(trace, &live);
+
+	/* util is mdriver's score for mm, best the highest one that the
+	   packed heap shows to be possible, gap how much bigger mm's
+	   heap is than the lower bound */
+	printf("%-20s %8d %10zu %10zu %10zu %10zu %5.1f%% %5.1f%% %5.2fx\n",
+	       tracefiles[i], trace->num_ops, live, lower, packed, mm,
+	       mm ? 100.0 * live / mm : 0.0,
+	       packed ? 100.0 * live / packed : 0.0,
+	       lower ? (double)mm / lower : 0.0);
+	free(blocks);
+	free_trace(trace);
+    }
+    exit(0);
+}
@@ -1,19 +1,29 @@
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+#include <stdint.h>
 #include <inttypes.h>
 #include "pagemap.h"
 
-/* Keep track of all mapped pages so that we can easily get a list of
-   all of them --- but also efficiently add and remove from the list. */
+/* Keep track of the mapped pages in two ways: as maximal runs of
+   mapped pages in a treap ordered by address, so that mapping or
+   unmapping any number of pages costs O(log runs) plus a bitmap
+   update, and as a sparse bitmap with one bit per page, so that
+   pagemap_is_mapped is a couple of loads. */
 
-typedef struct mpage {
-  void *addr;
-  struct mpage *prev, *next;
-} mpage;
+typedef struct run {
+  uintptr_t lo, hi;             /* the pages of [lo, hi) are mapped */
+  struct run *left, *right;
+  unsigned prio;                /* heap-ordered random priority */
+} run;
 
-static mpage *all_mapped_pages;
+static run *runs;
+static unsigned seed = 1;
 
-static mpage ***page_maps1;
+/* Each bitmap covers the 2^20 pages of 4 GB, one bit each */
+typedef uint64_t bitmap[(1 << (32 - LOG_APAGE_SIZE)) / 64];
+
+static bitmap ***page_maps1;
 
 #define PAGEMAP64_LEVEL1_SIZE (1 << 16)
 #define PAGEMAP64_LEVEL2_SIZE (1 << 16)
@@ -22,80 +32,253 @@ static mpage ***page_maps1;
 #define PAGEMAP64_LEVEL2_BITS(p) ((((uintptr_t)(p)) >> 32) & ((PAGEMAP64_LEVEL2_SIZE) - 1))
 #define PAGEMAP64_LEVEL3_BITS(p) ((((uintptr_t)(p)) >> LOG_APAGE_SIZE) & ((PAGEMAP64_LEVEL3_SIZE) - 1))
 
-void pagemap_modify(void *p, int mapped) {
-  uintptr_t pos;
-  mpage **page_maps2;
-  mpage *page_maps3;
-  mpage *page;
+static void *xcalloc(size_t n, size_t size) {
+  void *p = calloc(n, size);
 
-  if (!page_maps1) {
-    page_maps1 = calloc(PAGEMAP64_LEVEL1_SIZE, sizeof(mpage **));
+  if (!p) {
+    fprintf(stderr, "internal error: out of memory in pagemap\n");
+    abort();
   }
+  return p;
+}
+
+/* The bitmap covering p, created if create is set */
+static uint64_t *bitmap_of(uintptr_t p, int create) {
+  bitmap **page_maps2;
+  bitmap *page_maps3;
 
-  pos = PAGEMAP64_LEVEL1_BITS(p);
-  page_maps2 = page_maps1[pos];
+  if (!page_maps1) {
+    if (!create) return NULL;
+    page_maps1 = xcalloc(PAGEMAP64_LEVEL1_SIZE, sizeof(bitmap **));
+  }
+  page_maps2 = page_maps1[PAGEMAP64_LEVEL1_BITS(p)];
   if (!page_maps2) {
-    page_maps2 = calloc(PAGEMAP64_LEVEL2_SIZE, sizeof(mpage *));
-    page_maps1[pos] = page_maps2;
+    if (!create) return NULL;
+    page_maps2 = xcalloc(PAGEMAP64_LEVEL2_SIZE, sizeof(bitmap *));
+    page_maps1[PAGEMAP64_LEVEL1_BITS(p)] = page_maps2;
   }
-  
-  pos = PAGEMAP64_LEVEL2_BITS(p);
-  page_maps3 = page_maps2[pos];
+  page_maps3 = page_maps2[PAGEMAP64_LEVEL2_BITS(p)];
   if (!page_maps3) {
-    page_maps3 = calloc(PAGEMAP64_LEVEL3_SIZE, sizeof(mpage));
-    page_maps2[pos] = page_maps3;
+    if (!create) return NULL;
+    page_maps3 = xcalloc(1, sizeof(bitmap));
+    page_maps2[PAGEMAP64_LEVEL2_BITS(p)] = page_maps3;
   }
+  return *page_maps3;
+}
+
+/* Set or clear the bits of the pages of [lo, hi), a word at a time */
+static void set_bits(uintptr_t lo, uintptr_t hi, int mapped) {
+  uint64_t *bits, mask;
+  uintptr_t end;
+  size_t first, last, w;
+
+  while (lo < hi) {
+    /* the part of [lo, hi) that is in one bitmap */
+    end = (lo | (((uintptr_t)1 << 32) - 1)) + 1;
+    if (end > hi || end == 0)
+      end = hi;
+    bits = bitmap_of(lo, 1);
+    first = PAGEMAP64_LEVEL3_BITS(lo);
+    last = PAGEMAP64_LEVEL3_BITS(end - 1);
+
+    for (w = first / 64; w <= last / 64; w++) {
+      mask = ~(uint64_t)0;
+      if (w == first / 64)
+        mask &= ~(uint64_t)0 << (first % 64);
+      if (w == last / 64 && last % 64 != 63)
+        mask &= ((uint64_t)1 << (last % 64 + 1)) - 1;
+      if (mapped)
+        bits[w] |= mask;
+      else
+        bits[w] &= ~mask;
+    }
+    lo = end;
+  }
+}
 
-  page = &page_maps3[PAGEMAP64_LEVEL3_BITS(p)];
+/* The run with the greatest lo <= p, or NULL */
+static run *find_le(uintptr_t p) {
+  run *t = runs, *best = NULL;
+
+  while (t) {
+    if (t->lo <= p) {
+      best = t;
+      t = t->right;
+    } else
+      t = t->left;
+  }
+  return best;
+}
+
+/* The run with the least lo > p, or NULL */
+static run *find_gt(uintptr_t p) {
+  run *t = runs, *best = NULL;
+
+  while (t) {
+    if (t->lo > p) {
+      best = t;
+      t = t->left;
+    } else
+      t = t->right;
+  }
+  return best;
+}
+
+static void insert(run **root, run *r) {
+  run *t = *root;
+
+  if (!t) {
+    *root = r;
+    return;
+  }
+  if (r->lo < t->lo) {
+    insert(&t->left, r);
+    if (t->left->prio > t->prio) {
+      *root = t->left;
+      t->left = (*root)->right;
+      (*root)->right = t;
+    }
+  } else {
+    insert(&t->right, r);
+    if (t->right->prio > t->prio) {
+      *root = t->right;
+      t->right = (*root)->left;
+      (*root)->left = t;
+    }
+  }
+}
+
+static run *merge(run *a, run *b) {
+  if (!a) return b;
+  if (!b) return a;
+  if (a->prio > b->prio) {
+    a->right = merge(a->right, b);
+    return a;
+  }
+  b->left = merge(a, b->left);
+  return b;
+}
+
+/* Unlink r from the treap and free it */
+static void delete(run *r) {
+  run **link = &runs;
+
+  while (*link != r)
+    link = (r->lo < (*link)->lo) ? &(*link)->left : &(*link)->right;
+  *link = merge(r->left, r->right);
+  free(r);
+}
+
+static void add_run(uintptr_t lo, uintptr_t hi) {
+  run *r = xcalloc(1, sizeof(run));
+
+  r->lo = lo;
+  r->hi = hi;
+  seed ^= seed << 13;
+  seed ^= seed >> 17;
+  seed ^= seed << 5;
+  r->prio = seed;
+  insert(&runs, r);
+}
+
+void pagemap_modify_range(void *p, size_t size, int mapped) {
+  uintptr_t lo = (uintptr_t)p, hi = lo + size;
+  run *pred, *succ;
+
+  if (size == 0)
+    return;
+  pred = find_le(lo);
 
   if (mapped) {
-    if (page->addr) {
+    succ = find_gt(lo);
+    if ((pred && pred->hi > lo) || (succ && succ->lo < hi)) {
       fprintf(stderr, "internal error: page is already mapped\n");
       abort();
     }
-    if (page == all_mapped_pages)
-      abort();
-    page->addr = p;
-    page->prev = NULL;
-    page->next = all_mapped_pages;
-    if (all_mapped_pages)
-      all_mapped_pages->prev = page;
-    all_mapped_pages = page;
+    /* keep the runs maximal by absorbing the neighbors */
+    if (pred && pred->hi == lo) {
+      lo = pred->lo;
+      delete(pred);
+    }
+    if (succ && succ->lo == hi) {
+      hi = succ->hi;
+      delete(succ);
+    }
+    add_run(lo, hi);
   } else {
-    if (!page->addr) {
+    if (!pred || pred->hi < hi) {
       fprintf(stderr, "internal error: not currently mapped\n");
       abort();
     }
-    page->addr = NULL;
-    if (page->prev)
-      page->prev->next = page->next;
-    else
-      all_mapped_pages = page->next;
-    if (page->next)
-      page->next->prev = page->prev;
+    lo = pred->lo;
+    hi = pred->hi;
+    delete(pred);
+    if (lo < (uintptr_t)p)
+      add_run(lo, (uintptr_t)p);
+    if ((uintptr_t)p + size < hi)
+      add_run((uintptr_t)p + size, hi);
   }
+
+  set_bits((uintptr_t)p, (uintptr_t)p + size, mapped);
+}
+
+void pagemap_modify(void *p, int mapped) {
+  pagemap_modify_range(p, APAGE_SIZE, mapped);
 }
 
 int pagemap_is_mapped(void *p) {
-  mpage **page_maps2;
-  mpage *page_maps3;
+  uint64_t *bits = bitmap_of((uintptr_t)p, 0);
+  size_t i;
 
-  if (!page_maps1) return 0;
-  page_maps2 = page_maps1[PAGEMAP64_LEVEL1_BITS(p)];
-  if (!page_maps2) return 0;
-  page_maps3 = page_maps2[PAGEMAP64_LEVEL2_BITS(p)];
-  if (!page_maps3) return 0;
-  return !!page_maps3[PAGEMAP64_LEVEL3_BITS(p)].addr;
+  if (!bits) return 0;
+  i = PAGEMAP64_LEVEL3_BITS(p);
+  return (bits[i / 64] >> (i % 64)) & 1;
+}
+
+int pagemap_range_is_mapped(void *p, size_t size) {
+  run *r = find_le((uintptr_t)p);
+
+  return r && r->hi >= (uintptr_t)p + size;
+}
+
+void *pagemap_find_gap(void *p, size_t size) {
+  uintptr_t a = (uintptr_t)p;
+  run *r = find_le(a);
+
+  if (r && r->hi > a)
+    a = r->hi;
+  /* the runs are disjoint, so only the ones above a can be in the way */
+  while ((r = find_gt(a)) && r->lo < a + size)
+    a = r->hi;
+  return (void *)a;
+}
+
+/* Call f on each run of t in address order, then free them */
+static void for_each_run(run *t, page_callback pf, range_callback rf) {
+  uintptr_t a;
+
+  if (!t) return;
+  for_each_run(t->left, pf, rf);
+  set_bits(t->lo, t->hi, 0);
+  if (rf)
+    rf((void *)t->lo, t->hi - t->lo);
+  else
+    for (a = t->lo; a < t->hi; a += APAGE_SIZE)
+      pf((void *)a);
+  for_each_run(t->right, pf, rf);
+  free(t);
 }
 
 void pagemap_for_each(page_callback f) {
-  mpage *p, *next;
-  p = all_mapped_pages;
-  while (p) {
-    next = p->next;
-    f(p->addr);
-    pagemap_modify(p->addr, 0);
-    p = next;
-  }
-  all_mapped_pages = NULL;
+  run *t = runs;
+
+  runs = NULL;
+  for_each_run(t, f, NULL);
+}
+
+void pagemap_for_each_range(range_callback f) {
+  run *t = runs;
+
+  runs = NULL;
+  for_each_run(t, NULL, f);
 }
@@ -1,10 +1,31 @@
+#ifndef __PAGEMAP_H_
+#define __PAGEMAP_H_
+
+#include <stddef.h>
 
 typedef void (*page_callback)(void *addr);
+typedef void (*range_callback)(void *addr, size_t size);
 
+/* Mark one page, or the pages of [addr, addr+size), mapped or not */
 void pagemap_modify(void *addr, int mapped);
+void pagemap_modify_range(void *addr, size_t size, int mapped);
+
 int pagemap_is_mapped(void *addr);
+
+/* Is every page of [addr, addr+size) mapped? */
+int pagemap_range_is_mapped(void *addr, size_t size);
+
+/* The lowest address at or above addr from which size bytes hold no
+   mapped page */
+void *pagemap_find_gap(void *addr, size_t size);
+
+/* Call f on every mapped page, or on every maximal run of mapped
+   pages, and then forget them all */
 void pagemap_for_each(page_callback f);
+void pagemap_for_each_range(range_callback f);
 
 /* APAGE_SIZE needs to match the actual page size */
 #define LOG_APAGE_SIZE 12
 #define APAGE_SIZE (1 << LOG_APAGE_SIZE)
+
+#endif /* __PAGEMAP_H_ */
@@ -0,0 +1,175 @@
+/*
+ * perfctr.c - Event counters using perf_event_open
+ *
+ * Each event is opened as its own counter, so that one unsupported
+ * event (common in VMs and containers) does not take the others down
+ * with it. Hardware events count user space only, which is all an
+ * unprivileged process may count at the default perf_event_paranoid
+ * level. When the software events can't be opened either, page
+ * faults and context switches are taken from getrusage instead.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <sys/resource.h>
+#include <linux/perf_event.h>
+
+#include "perfctr.h"
+
+const char *perfctr_names[PC_NEVENTS] = {
+    "instructions", "cycles", "l1d_misses", "llc_misses",
+    "dtlb_misses", "branch_misses", "page_faults", "context_switches"
+};
+
+#define CACHE_MISS(cache) \
+    ((cache) | (PERF_COUNT_HW_CACHE_OP_READ << 8) | \
+     (PERF_COUNT_HW_CACHE_RESULT_MISS << 16))
+
+/* perf_event_open type and config of each PC_xxx event */
+static const struct {
+    uint32_t type;
+    uint64_t config;
+} events[PC_NEVENTS] = {
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+    { PERF_TYPE_HW_CACHE, CACHE_MISS(PERF_COUNT_HW_CACHE_L1D) },
+    { PERF_TYPE_HW_CACHE, CACHE_MISS(PERF_COUNT_HW_CACHE_LL) },
+    { PERF_TYPE_HW_CACHE, CACHE_MISS(PERF_COUNT_HW_CACHE_DTLB) },
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES },
+    { PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS },
+    { PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES },
+};
+
+static int initialized = 0;
+static int fds[PC_NEVENTS];
+static perfctr_t totals;
+static struct rusage start_usage;  /* for the PC_RUSAGE events */
+
+/* open one event for this process, on any CPU, initially disabled */
+static int open_event(int e)
+{
+    struct perf_event_attr attr;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = events[e].type;
+    attr.config = events[e].config;
+    attr.disabled = 1;
+    attr.exclude_kernel = (events[e].type != PERF_TYPE_SOFTWARE);
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED
+	| PERF_FORMAT_TOTAL_TIME_RUNNING;
+    return syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+/*
+ * perfctr_init - Open a counter for every event the system supports
+ */
+int perfctr_init(void)
+{
+    int e, n = 0;
+
+    for (e = 0; e < PC_NEVENTS; e++) {
+	fds[e] = open_event(e);
+	if (fds[e] >= 0)
+	    totals.source[e] = PC_PERF;
+	else if (e == PC_PAGE_FAULTS || e == PC_CONTEXT_SWITCHES)
+	    totals.source[e] = PC_RUSAGE;
+	else
+	    totals.source[e] = PC_NONE;
+	n += (totals.source[e] != PC_NONE);
+    }
+    initialized = 1;
+    return n;
+}
+
+/*
+ * perfctr_reopen - Replace the counters inherited across a fork, which
+ *     are attached to the parent, with counters for this process
+ */
+void perfctr_reopen(void)
+{
+    int e;
+
+    if (!initialized)
+	return;
+    for (e = 0; e < PC_NEVENTS; e++) {
+	if (fds[e] < 0)
+	    continue;
+	close(fds[e]);
+	fds[e] = open_event(e);
+    }
+}
+
+/*
+ * perfctr_start - Reset and enable the counters
+ */
+void perfctr_start(void)
+{
+    int e;
+
+    if (!initialized)
+	return;
+    getrusage(RUSAGE_SELF, &start_usage);
+    for (e = 0; e < PC_NEVENTS; e++) {
+	if (fds[e] < 0)
+	    continue;
+	ioctl(fds[e], PERF_EVENT_IOC_RESET, 0);
+	ioctl(fds[e], PERF_EVENT_IOC_ENABLE, 0);
+    }
+}
+
+/*
+ * perfctr_stop - Disable the counters and add their counts to the
+ *     totals, scaled up if the kernel had to multiplex them
+ */
+void perfctr_stop(void)
+{
+    uint64_t buf[3];   /* value, time enabled, time running */
+    struct rusage usage;
+    int e;
+
+    if (!initialized)
+	return;
+    for (e = 0; e < PC_NEVENTS; e++) {
+	if (fds[e] < 0)
+	    continue;
+	ioctl(fds[e], PERF_EVENT_IOC_DISABLE, 0);
+	if (read(fds[e], buf, sizeof(buf)) != sizeof(buf) || buf[2] == 0)
+	    continue;
+	totals.counts[e] += (double)buf[0] * buf[1] / buf[2];
+    }
+    getrusage(RUSAGE_SELF, &usage);
+    if (totals.source[PC_PAGE_FAULTS] == PC_RUSAGE)
+	totals.counts[PC_PAGE_FAULTS] +=
+	    (usage.ru_minflt - start_usage.ru_minflt)
+	    + (usage.ru_majflt - start_usage.ru_majflt);
+    if (totals.source[PC_CONTEXT_SWITCHES] == PC_RUSAGE)
+	totals.counts[PC_CONTEXT_SWITCHES] +=
+	    (usage.ru_nvcsw - start_usage.ru_nvcsw)
+	    + (usage.ru_nivcsw - start_usage.ru_nivcsw);
+    totals.regions++;
+}
+
+/*
+ * perfctr_clear - Zero the accumulated counts
+ */
+void perfctr_clear(void)
+{
+    int e;
+
+    for (e = 0; e < PC_NEVENTS; e++)
+	totals.counts[e] = 0;
+    totals.regions = 0;
+}
+
+/*
+ * perfctr_read - Copy out the accumulated counts
+ */
+void perfctr_read(perfctr_t *pc)
+{
+    *pc = totals;
+}
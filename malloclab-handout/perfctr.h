@@ -0,0 +1,46 @@
+/*
+ * perfctr.h - Hardware and software event counters around a region of
+ *     code, using perf_event_open with a getrusage fallback
+ */
+#ifndef __PERFCTR_H_
+#define __PERFCTR_H_
+
+/* The events that are counted, when the system allows it */
+enum {
+    PC_INSTRUCTIONS, PC_CYCLES, PC_L1D_MISSES, PC_LLC_MISSES,
+    PC_DTLB_MISSES, PC_BRANCH_MISSES, PC_PAGE_FAULTS, PC_CONTEXT_SWITCHES,
+    PC_NEVENTS
+};
+
+/* Where the count for an event came from */
+#define PC_NONE   0   /* not available on this system */
+#define PC_PERF   1   /* perf_event_open */
+#define PC_RUSAGE 2   /* getrusage, for the software events only */
+
+/* Event totals accumulated over some number of counted regions */
+typedef struct {
+    double counts[PC_NEVENTS];
+    int source[PC_NEVENTS];   /* PC_xxx source of each count */
+    int regions;              /* number of start/stop pairs */
+} perfctr_t;
+
+/* Short names of the PC_xxx events, for printing */
+extern const char *perfctr_names[PC_NEVENTS];
+
+/* Open the counters. Return the number of events that can be counted */
+int perfctr_init(void);
+
+/* Open the counters again in a forked child, which would otherwise
+   count its parent. Does nothing unless perfctr_init has been called */
+void perfctr_reopen(void);
+
+/* Count events between perfctr_start and perfctr_stop. Both do nothing
+   unless perfctr_init has been called */
+void perfctr_start(void);
+void perfctr_stop(void);
+
+/* Zero the running totals, or copy them out */
+void perfctr_clear(void);
+void perfctr_read(perfctr_t *pc);
+
+#endif /* __PERFCTR_H_ */
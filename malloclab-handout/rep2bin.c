@@ -0,0 +1,68 @@
+/*
+ * rep2bin.c - Convert text (.rep) traces to the binary trace format
+ *
+ * Usage: rep2bin <file.rep>...
+ *        rep2bin -o <out> <file.rep>
+ *
+ * Each file.rep is written next to itself as file.bin, unless -o
+ * names the output of a single trace. mdriver reads either format.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "trace.h"
+
+static void usage(void)
+{
+    fprintf(stderr, "Usage: rep2bin [-o <out>] <file.rep>...\n");
+    fprintf(stderr, "\t-o <out>   Output file, when converting a single trace.\n");
+    exit(1);
+}
+
+int main(int argc, char **argv)
+{
+    char *outfile = NULL, *out, *dot;
+    trace_t *trace;
+    int c, i;
+
+    while ((c = getopt(argc, argv, "o:h")) != EOF) {
+	switch (c) {
+	case 'o':
+	    outfile = optarg;
+	    break;
+	default:
+	    usage();
+	}
+    }
+    if (optind == argc || (outfile != NULL && argc - optind > 1))
+	usage();
+
+    for (i = optind; i < argc; i++) {
+	if (outfile != NULL)
+	    out = outfile;
+	else {
+	    /* file.rep -> file.bin */
+	    if ((out = malloc(strlen(argv[i]) + 5)) == NULL) {
+		perror("rep2bin");
+		exit(1);
+	    }
+	    strcpy(out, argv[i]);
+	    if ((dot = strrchr(out, '.')) != NULL && strchr(dot, '/') == NULL)
+		*dot = 0;
+	    strcat(out, ".bin");
+	}
+
+	trace = read_trace("", argv[i]);
+	if (write_trace_bin(out, trace) < 0) {
+	    perror(out);
+	    exit(1);
+	}
+	printf("%s: %d ops -> %s\n", argv[i], trace->num_ops, out);
+	free_trace(trace);
+	if (out != outfile)
+	    free(out);
+    }
+    exit(0);
+}
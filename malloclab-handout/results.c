@@ -0,0 +1,503 @@
+/*
+ * results.c - Write mdriver results as JSON or CSV
+ *
+ * Each record carries the build (compiler, flags, git revision) and
+ * host it was measured on, so that results from many runs and machines
+ * can be loaded into one store and told apart.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/utsname.h>
+
+#include "results.h"
+
+/* These are normally supplied by the Makefile */
+#ifndef BUILD_CFLAGS
+#define BUILD_CFLAGS "unknown"
+#endif
+#ifndef BUILD_GIT
+#define BUILD_GIT "unknown"
+#endif
+
+#if defined(__GNUC__) && !defined(__clang__)
+#define COMPILER "gcc " __VERSION__
+#else
+#define COMPILER __VERSION__
+#endif
+
+#define MAXLINE 1024
+
+/*
+ * get_hostinfo - Fill in a description of this machine
+ */
+void get_hostinfo(hostinfo_t *h)
+{
+    FILE *fp;
+    char line[MAXLINE], *p;
+
+    if (gethostname(h->hostname, sizeof(h->hostname)) < 0)
+	strcpy(h->hostname, "unknown");
+    h->hostname[sizeof(h->hostname) - 1] = 0;
+    if (uname(&h->uts) < 0)
+	memset(&h->uts, 0, sizeof(h->uts));
+    h->ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+    h->page_size = sysconf(_SC_PAGESIZE);
+
+    strcpy(h->cpu, "unknown");
+    if ((fp = fopen("/proc/cpuinfo", "r")) == NULL)
+	return;
+    while (fgets(line, MAXLINE, fp) != NULL) {
+	if (strncmp(line, "model name", 10) == 0
+	    && (p = strchr(line, ':')) != NULL) {
+	    p += 1 + strspn(p + 1, " \t");
+	    p[strcspn(p, "\n")] = 0;
+	    strcpy(h->cpu, p);
+	    break;
+	}
+    }
+    fclose(fp);
+}
+
+/* return the name of the timer the results were measured with */
+static const char *timer_name(runinfo_t *info)
+{
+    if (!info->rigorous)
+	return "fsecs";
+    return (info->clock == FTIMER_TSC) ? "rigorous-tsc" : "rigorous-raw";
+}
+
+/* the count of event e per op, or -1 if it was not counted */
+static double per_op(stats_t *s, int e)
+{
+    double ops = s->ops * s->counters.regions;
+
+    if (s->counters.source[e] == PC_NONE || ops == 0)
+	return -1;
+    return s->counters.counts[e] / ops;
+}
+
+/* Kops/sec for a trace or total, or 0 when nothing was timed */
+static double kops(double ops, double secs)
+{
+    return (secs > 0) ? (ops/1e3)/secs : 0;
+}
+
+/* speed of s relative to the reference ref, >1 if s is faster */
+static double speed_ratio(stats_t *s, stats_t *ref)
+{
+    return (s->ops / s->secs) / (ref->ops / ref->secs);
+}
+
+/*****************
+ * JSON output
+ *****************/
+
+/* write s as a JSON string literal */
+static void json_str(FILE *fp, const char *s)
+{
+    fputc('"', fp);
+    for (; *s; s++) {
+	if (*s == '"' || *s == '\\')
+	    fprintf(fp, "\\%c", *s);
+	else if ((unsigned char)*s < 0x20)
+	    fprintf(fp, "\\u%04x", *s);
+	else
+	    fputc(*s, fp);
+    }
+    fputc('"', fp);
+}
+
+/* write "key": "s" */
+static void json_kstr(FILE *fp, const char *key, const char *s)
+{
+    json_str(fp, key);
+    fputs(": ", fp);
+    json_str(fp, s);
+}
+
+/* write "util" and "inst_util", which are null if they weren't
+   measured, rather than a misleading 0 */
+static void json_util(FILE *fp, int has_util, double util, double inst_util)
+{
+    if (has_util)
+	fprintf(fp, "\"util\": %.6g, \"inst_util\": %.6g", util, inst_util);
+    else
+	fprintf(fp, "\"util\": null, \"inst_util\": null");
+}
+
+/* write one trace's stats as a JSON object */
+static void json_trace(FILE *fp, runinfo_t *info, int i, stats_t *s,
+		       stats_t *ref, int has_util)
+{
+    int op, first;
+    double r;
+
+    fprintf(fp, "        {");
+    json_kstr(fp, "trace", info->tracefiles[i]);
+    fprintf(fp, ", \"index\": %d, \"ops\": %.0f, \"valid\": %s",
+	    i, s->ops, s->valid ? "true" : "false");
+    if (!s->valid) {
+	fprintf(fp, "}");
+	return;
+    }
+    fprintf(fp, ",\n         \"secs\": %.9g, \"kops\": %.6g, ",
+	    s->secs, kops(s->ops, s->secs));
+    json_util(fp, has_util, s->util, s->inst_util);
+    if (ref != NULL && ref->valid)
+	fprintf(fp, ", \"libc_ratio\": %.6g", speed_ratio(s, ref));
+    fprintf(fp, ",\n         \"phase_secs\": {\"setup\": %.9g, "
+	    "\"replay\": %.9g, \"teardown\": %.9g}",
+	    s->phase_secs[FSECS_SETUP], s->phase_secs[FSECS_REPLAY],
+	    s->phase_secs[FSECS_TEARDOWN]);
+    if (info->rigorous)
+	fprintf(fp, ",\n         \"timing\": {\"reps\": %d, \"min\": %.9g, "
+		"\"median\": %.9g, \"mean\": %.9g, \"stddev\": %.9g, "
+		"\"ci95\": %.9g}",
+		s->timing.reps, s->timing.min, s->timing.median,
+		s->timing.mean, s->timing.stddev, s->timing.ci95);
+    if (info->latency) {
+	fprintf(fp, ",\n         \"latency_ns\": {");
+	for (op = 0; op < LAT_NOPS; op++)
+	    fprintf(fp, "%s\"%s\": {\"count\": %.0f, \"p50\": %.0f, "
+		    "\"p99\": %.0f, \"p999\": %.0f, \"max\": %.0f}",
+		    op ? ", " : "", lat_op_names[op], s->lat[op].count,
+		    s->lat[op].p50, s->lat[op].p99, s->lat[op].p999,
+		    s->lat[op].max);
+	fprintf(fp, "}");
+    }
+    if (info->counters) {
+	fprintf(fp, ",\n         \"counters_per_op\": {");
+	for (op = 0, first = 1; op < PC_NEVENTS; op++) {
+	    if (per_op(s, op) < 0)
+		continue;
+	    fprintf(fp, "%s\"%s\": %.6g", first ? "" : ", ",
+		    perfctr_names[op], per_op(s, op));
+	    first = 0;
+	}
+	fprintf(fp, "}");
+    }
+    if (s->mem_runs > 0) {
+	r = s->mem_runs;
+	fprintf(fp, ",\n         \"memlib_per_replay\": {\"mmap\": %.6g, "
+		"\"mmap_bytes\": %.9g, \"mmap_secs\": %.6g, \"munmap\": %.6g, "
+		"\"munmap_bytes\": %.9g, \"munmap_secs\": %.6g, "
+		"\"noise_mmap\": %.6g, \"noise_secs\": %.6g, \"mmap_pages_hist\": [",
+		s->mem.maps / r, s->mem.map_bytes / r, s->mem.map_secs / r,
+		s->mem.unmaps / r, s->mem.unmap_bytes / r, 
+		s->mem.unmap_secs / r, s->mem.noise_maps / r, 
+		s->mem.noise_secs / r);
+	for (op = 0; op < MEM_SIZE_BINS; op++)
+	    fprintf(fp, "%s%.6g", op ? ", " : "", s->mem.map_hist[op] / r);
+	fprintf(fp, "]}");
+    }
+    if (s->counts_runs > 0) {
+	r = s->counts_runs;
+	fprintf(fp, ",\n         \"mm_counts_per_replay\": {\"searches\": %.6g, "
+		"\"visited\": %.6g, \"misses\": %.6g, \"splits\": %.6g, "
+		"\"extends\": %.6g, \"unmaps\": %.6g, \"coalesce\": "
+		"{\"none\": %.6g, \"next\": %.6g, \"prev\": %.6g, "
+		"\"both\": %.6g}, \"search_hist\": [",
+		s->mm_counts.searches / r, s->mm_counts.visited / r,
+		s->mm_counts.misses / r, s->mm_counts.splits / r,
+		s->mm_counts.extends / r, s->mm_counts.unmaps / r,
+		s->mm_counts.coalesce[MM_COALESCE_NONE] / r,
+		s->mm_counts.coalesce[MM_COALESCE_NEXT] / r,
+		s->mm_counts.coalesce[MM_COALESCE_PREV] / r,
+		s->mm_counts.coalesce[MM_COALESCE_BOTH] / r);
+	for (op = 0; op < MM_SEARCH_BINS; op++)
+	    fprintf(fp, "%s%.6g", op ? ", " : "", s->mm_counts.search_hist[op] / r);
+	fprintf(fp, "]}");
+    }
+    if (info->frag && s->frag.snapshots > 0) {
+	fprintf(fp, ",\n         \"frag\": {\"snapshots\": %d, "
+		"\"avg_index\": %.6g, \"peak\": {\"live\": %.0f, "
+		"\"index\": %.6g, \"free\": %.0f, \"largest_free\": %.0f, "
+		"\"chunks\": %.0f, \"occupancy\": %.6g, \"free_hist\": [",
+		s->frag.snapshots, s->frag.avg_index, s->frag.peak_live,
+		s->frag.peak_index, s->frag.peak_free, s->frag.peak_largest,
+		s->frag.peak_chunks, s->frag.peak_occ);
+	for (op = 0; op < MM_SIZE_BINS; op++)
+	    fprintf(fp, "%s%.0f", op ? ", " : "", s->frag.peak_hist[op]);
+	fprintf(fp, "], \"chunk_occ\": [");
+	for (op = 0; op < MM_OCC_BINS; op++)
+	    fprintf(fp, "%s%.0f", op ? ", " : "", s->frag.peak_chunk_occ[op]);
+	fprintf(fp, "]}}");
+    }
+    fprintf(fp, "}");
+}
+
+/* write the results of one malloc package as a JSON object */
+static void json_results(FILE *fp, runinfo_t *info, results_t *r)
+{
+    int i;
+
+    fprintf(fp, "    {");
+    json_kstr(fp, "allocator", r->name);
+    fprintf(fp, ",\n      \"traces\": [\n");
+    for (i = 0; i < r->n; i++) {
+	json_trace(fp, info, i, &r->stats[i], r->ref ? &r->ref[i] : NULL,
+		   r->has_util);
+	fprintf(fp, "%s\n", (i < r->n - 1) ? "," : "");
+    }
+    fprintf(fp, "      ],\n      \"aggregate\": {\"traces\": %d, "
+	    "\"correct\": %d, \"ops\": %.0f, \"secs\": %.9g, \"kops\": %.6g, ",
+	    r->n, r->numcorrect, r->ops, r->secs, kops(r->ops, r->secs));
+    json_util(fp, r->has_util, r->util, r->inst_util);
+    if (r->has_index)
+	fprintf(fp, ", \"perf_index\": {\"util\": %.6g, \"inst_util\": %.6g, "
+		"\"thru\": %.6g, \"total\": %.6g, \"thru_ref_kops\": %.6g, "
+		"\"calibrated\": %s}",
+		r->p_util*100, r->p_inst_util*100, r->p_thru*100, r->perfindex,
+		r->thru_ref/1e3, r->calibrated ? "true" : "false");
+    fprintf(fp, "}}");
+}
+
+/* write all of the results as a single JSON document */
+static void write_json(FILE *fp, runinfo_t *info, hostinfo_t *h,
+		       results_t *res, int nres)
+{
+    int i;
+
+    fprintf(fp, "{\n  \"format_version\": 1,\n  \"timestamp\": %ld,\n",
+	    (long)time(NULL));
+    fprintf(fp, "  \"build\": {");
+    json_kstr(fp, "compiler", COMPILER);
+    fprintf(fp, ", ");
+    json_kstr(fp, "cflags", BUILD_CFLAGS);
+    fprintf(fp, ", ");
+    json_kstr(fp, "git", BUILD_GIT);
+    fprintf(fp, "},\n  \"host\": {");
+    json_kstr(fp, "hostname", h->hostname);
+    fprintf(fp, ", ");
+    json_kstr(fp, "os", h->uts.sysname);
+    fprintf(fp, ", ");
+    json_kstr(fp, "release", h->uts.release);
+    fprintf(fp, ", ");
+    json_kstr(fp, "machine", h->uts.machine);
+    fprintf(fp, ", ");
+    json_kstr(fp, "cpu", h->cpu);
+    fprintf(fp, ", \"ncpus\": %ld, \"page_size\": %ld},\n",
+	    h->ncpus, h->page_size);
+    fprintf(fp, "  \"run\": {");
+    json_kstr(fp, "tracedir", info->tracedir);
+    fprintf(fp, ", ");
+    json_kstr(fp, "timer", timer_name(info));
+    fprintf(fp, ", \"pinned_cpu\": %d, \"errors\": %d",
+	    info->cpu, info->errors);
+    if (info->layout)
+	fprintf(fp, ", \"layout\": {\"base\": \"%#lx\", \"seed\": %u}",
+		info->layout_base, info->layout_seed);
+    fprintf(fp, "},\n");
+    fprintf(fp, "  \"results\": [\n");
+    for (i = 0; i < nres; i++) {
+	json_results(fp, info, &res[i]);
+	fprintf(fp, "%s\n", (i < nres - 1) ? "," : "");
+    }
+    fprintf(fp, "  ]\n}\n");
+}
+
+/*****************
+ * CSV output
+ *****************/
+
+/* write s as a CSV field, quoting it if needed */
+static void csv_str(FILE *fp, const char *s)
+{
+    if (strpbrk(s, ",\"\n") == NULL) {
+	fputs(s, fp);
+	return;
+    }
+    fputc('"', fp);
+    for (; *s; s++) {
+	if (*s == '"')
+	    fputc('"', fp);
+	fputc(*s, fp);
+    }
+    fputc('"', fp);
+}
+
+/* write the columns that are the same on every row */
+static void csv_context(FILE *fp, runinfo_t *info, hostinfo_t *h)
+{
+    fputc(',', fp);
+    csv_str(fp, timer_name(info));
+    fputc(',', fp);
+    csv_str(fp, BUILD_GIT);
+    fputc(',', fp);
+    csv_str(fp, BUILD_CFLAGS);
+    fputc(',', fp);
+    csv_str(fp, COMPILER);
+    fputc(',', fp);
+    csv_str(fp, h->hostname);
+    fputc(',', fp);
+    csv_str(fp, h->cpu);
+    fprintf(fp, ",%ld\n", h->ncpus);
+}
+
+/* write the util and inst_util columns, empty if they weren't
+   measured */
+static void csv_util(FILE *fp, int has_util, double util, double inst_util)
+{
+    if (has_util)
+	fprintf(fp, ",%.6g,%.6g", util, inst_util);
+    else
+	fprintf(fp, ",,");
+}
+
+/* write every trace of every malloc package, one row each, with a
+   "total" row per package */
+static void write_csv(FILE *fp, runinfo_t *info, hostinfo_t *h,
+		      results_t *res, int nres)
+{
+    int i, j, op;
+    stats_t *s;
+    results_t *r;
+
+    fprintf(fp, "allocator,index,trace,ops,valid,secs,kops,util,inst_util,"
+	    "setup_secs,teardown_secs,reps,secs_min,secs_median,secs_stddev,"
+	    "secs_ci95");
+    for (op = 0; op < LAT_NOPS; op++)
+	fprintf(fp, ",%s_p50_ns,%s_p99_ns,%s_p999_ns,%s_max_ns",
+		lat_op_names[op], lat_op_names[op], lat_op_names[op],
+		lat_op_names[op]);
+    for (op = 0; op < PC_NEVENTS; op++)
+	fprintf(fp, ",%s_per_op", perfctr_names[op]);
+    fprintf(fp, ",frag_index_avg,frag_index_peak");
+    fprintf(fp, ",mmap_per_replay,munmap_per_replay,syscall_secs");
+    fprintf(fp, ",visits_per_search,splits_per_replay,coalesces_per_replay,"
+	    "extends_per_replay,unmaps_per_replay");
+    fprintf(fp, ",libc_ratio,perf_index,timer,git,cflags,compiler,host,cpu,"
+	    "ncpus\n");
+
+    for (i = 0; i < nres; i++) {
+	r = &res[i];
+	for (j = 0; j < r->n; j++) {
+	    s = &r->stats[j];
+	    csv_str(fp, r->name);
+	    fprintf(fp, ",%d,", j);
+	    csv_str(fp, info->tracefiles[j]);
+	    fprintf(fp, ",%.0f,%d", s->ops, s->valid);
+	    if (s->valid) {
+		fprintf(fp, ",%.9g,%.6g", s->secs, kops(s->ops, s->secs));
+		csv_util(fp, r->has_util, s->util, s->inst_util);
+		fprintf(fp, ",%.9g,%.9g", s->phase_secs[FSECS_SETUP],
+			s->phase_secs[FSECS_TEARDOWN]);
+	    }
+	    else
+		fprintf(fp, ",,,,,,");
+	    if (s->valid && info->rigorous)
+		fprintf(fp, ",%d,%.9g,%.9g,%.9g,%.9g", s->timing.reps,
+			s->timing.min, s->timing.median, s->timing.stddev,
+			s->timing.ci95);
+	    else
+		fprintf(fp, ",,,,,");
+	    for (op = 0; op < LAT_NOPS; op++) {
+		if (s->valid && info->latency)
+		    fprintf(fp, ",%.0f,%.0f,%.0f,%.0f", s->lat[op].p50,
+			    s->lat[op].p99, s->lat[op].p999, s->lat[op].max);
+		else
+		    fprintf(fp, ",,,,");
+	    }
+	    for (op = 0; op < PC_NEVENTS; op++) {
+		if (s->valid && info->counters && per_op(s, op) >= 0)
+		    fprintf(fp, ",%.6g", per_op(s, op));
+		else
+		    fprintf(fp, ",");
+	    }
+	    if (s->valid && info->frag && s->frag.snapshots > 0)
+		fprintf(fp, ",%.6g,%.6g", s->frag.avg_index, 
+			s->frag.peak_index);
+	    else
+		fprintf(fp, ",,");
+	    if (s->valid && s->mem_runs > 0)
+		fprintf(fp, ",%.6g,%.6g,%.6g", 
+			(double)s->mem.maps / s->mem_runs,
+			(double)s->mem.unmaps / s->mem_runs,
+			(s->mem.map_secs + s->mem.unmap_secs) / s->mem_runs);
+	    else
+		fprintf(fp, ",,,");
+	    if (s->valid && s->counts_runs > 0)
+		fprintf(fp, ",%.6g,%.6g,%.6g,%.6g,%.6g",
+			s->mm_counts.searches ? (double)s->mm_counts.visited /
+			s->mm_counts.searches : 0.0,
+			(double)s->mm_counts.splits / s->counts_runs,
+			(double)(s->mm_counts.coalesce[MM_COALESCE_NEXT] +
+				 s->mm_counts.coalesce[MM_COALESCE_PREV] +
+				 s->mm_counts.coalesce[MM_COALESCE_BOTH]) /
+			s->counts_runs,
+			(double)s->mm_counts.extends / s->counts_runs,
+			(double)s->mm_counts.unmaps / s->counts_runs);
+	    else
+		fprintf(fp, ",,,,,");
+	    if (s->valid && r->ref != NULL && r->ref[j].valid)
+		fprintf(fp, ",%.6g,", speed_ratio(s, &r->ref[j]));
+	    else
+		fprintf(fp, ",,");
+	    csv_context(fp, info, h);
+	}
+
+	csv_str(fp, r->name);
+	fprintf(fp, ",,total,%.0f,%d,%.9g,%.6g",
+		r->ops, r->numcorrect == r->n, r->secs, kops(r->ops, r->secs));
+	csv_util(fp, r->has_util, r->util, r->inst_util);
+	fprintf(fp, ",,,,,,,");
+	for (op = 0; op < LAT_NOPS; op++)
+	    fprintf(fp, ",,,,");
+	for (op = 0; op < PC_NEVENTS; op++)
+	    fprintf(fp, ",");
+	fprintf(fp, ",,,,,,,,,,");
+	if (r->has_index && r->calibrated && r->thru_ref > 0)
+	    fprintf(fp, ",%.6g", kops(r->ops, r->secs) * 1e3 / r->thru_ref);
+	else
+	    fprintf(fp, ",");
+	if (r->has_index)
+	    fprintf(fp, ",%.6g", r->perfindex);
+	else
+	    fprintf(fp, ",");
+	csv_context(fp, info, h);
+    }
+}
+
+/*
+ * results_totals - Sum the ops and secs of the valid traces in r, and
+ *     average the utilization over all of them
+ */
+void results_totals(results_t *r)
+{
+    int i;
+
+    r->numcorrect = 0;
+    r->ops = r->secs = r->util = r->inst_util = 0;
+    for (i = 0; i < r->n; i++) {
+	if (!r->stats[i].valid)
+	    continue;
+	r->numcorrect++;
+	r->ops += r->stats[i].ops;
+	r->secs += r->stats[i].secs;
+	r->util += r->stats[i].util;
+	r->inst_util += r->stats[i].inst_util;
+    }
+    if (r->n > 0) {
+	r->util /= r->n;
+	r->inst_util /= r->n;
+    }
+}
+
+/*
+ * write_results - Write the results of nres malloc packages to fp
+ */
+void write_results(FILE *fp, int format, runinfo_t *info,
+		   results_t *res, int nres)
+{
+    hostinfo_t host;
+
+    get_hostinfo(&host);
+    if (format == FORMAT_JSON)
+	write_json(fp, info, &host, res, nres);
+    else
+	write_csv(fp, info, &host, res, nres);
+    fflush(fp);
+}
@@ -0,0 +1,140 @@
+/*
+ * results.h - Per-trace statistics gathered by mdriver, and routines
+ *     that write them out in a machine-readable form.
+ */
+#ifndef __RESULTS_H_
+#define __RESULTS_H_
+
+#include <stdio.h>
+#include <sys/utsname.h>
+#include "ftimer.h"
+#include "fsecs.h"
+#include "lathist.h"
+#include "perfctr.h"
+#include "mm.h"
+#include "memlib.h"
+
+/* Fragmentation of a heap over one trace, from snapshots (--frag) */
+typedef struct {
+    int snapshots;       /* number of periodic snapshots */
+    double avg_index;    /* their mean external fragmentation index,
+			    1 - largest free block / free bytes */
+    double peak_live;    /* peak live bytes, and at that point... */
+    double peak_index;   /* ... the fragmentation index */
+    double peak_free;    /* ... the free bytes */
+    double peak_largest; /* ... the largest free block */
+    double peak_chunks;  /* ... the number of chunks */
+    double peak_occ;     /* ... the share of chunk bytes not free */
+    double peak_hist[MM_SIZE_BINS]; /* ... free blocks by size class */
+    double peak_chunk_occ[MM_OCC_BINS]; /* ... chunks by occupancy */
+} fragsum_t;
+
+/* Summarizes the important stats for some malloc function on some trace */
+typedef struct {
+    /* defined for both libc malloc and student malloc package (mm.c) */
+    double ops;      /* number of ops (malloc/free/realloc) in the trace */
+    int valid;       /* was the trace processed correctly by the allocator? */
+    double secs;     /* number of secs needed to replay the trace */
+    double phase_secs[FSECS_NPHASES]; /* setup/replay/teardown secs per run */
+
+    /* defined only for the student malloc package */
+    double util;     /* overall space utilization for this trace (0, and
+			not written out, for a package without a heapsize) */
+
+    double inst_util;     /* instanteous space utilization for this trace (likewise) */
+
+    /* defined only in the statistically rigorous timing mode */
+    ftimer_stats_t timing;  /* distribution of the timed samples */
+
+    /* defined only when per-op latency is measured (-L) */
+    latsum_t lat[LAT_NOPS]; /* latency percentiles for each op type */
+
+    /* defined only when events are counted (--counters) */
+    perfctr_t counters;     /* totals over all of the timed runs */
+
+    /* defined only when fragmentation is sampled (--frag) */
+    fragsum_t frag;
+
+    /* defined only for packages that use memlib: its system calls,
+       totalled over mem_runs timed replays */
+    mem_stats_t mem;
+    int mem_runs;
+
+    /* defined only for an mm.c built with MM_PROFILE (phased set): the
+       cycles in each of its phases, also over mem_runs replays */
+    mm_phases_t phases;
+    int phased;
+
+    /* defined only for packages with mm_counts_get: its free list
+       searches, splits and so on, over counts_runs timed replays */
+    mm_counts_t mm_counts;
+    int counts_runs;
+
+    /* Note: secs and util are only defined if valid is true */
+} stats_t;
+
+/* The results of one malloc package over the whole set of traces */
+typedef struct {
+    const char *name;    /* "mm" or "libc" */
+    int n;               /* number of traces */
+    stats_t *stats;      /* n per-trace stats */
+
+    /* totals over the valid traces, filled in by results_totals */
+    int numcorrect;
+    double ops;
+    double secs;
+    double util;         /* averages over all n traces */
+    double inst_util;
+    int has_util;        /* set if utilization was measured; a package
+			    that doesn't report its heap size has none */
+
+    /* the performance index, when has_index is set */
+    int has_index;
+    double p_util, p_inst_util, p_thru, perfindex;
+    double thru_ref;     /* libc ops/sec that p_thru is measured against */
+    int calibrated;      /* set if thru_ref was measured on this host */
+
+    /* libc stats for each trace to compare speed with, or NULL */
+    stats_t *ref;
+} results_t;
+
+/* Describes how the results were measured */
+typedef struct {
+    char **tracefiles;   /* names of the n traces */
+    const char *tracedir;
+    int errors;          /* number of errors reported by the driver */
+    int rigorous;        /* set if --rigorous timing was used... */
+    int clock;           /* ...with this FTIMER_xxx clock */
+    int cpu;             /* CPU the driver was pinned to, or -1 */
+    int latency;         /* set if per-op latencies were measured */
+    int counters;        /* set if events were counted */
+    int frag;            /* set if fragmentation was sampled */
+    int layout;          /* set if mm's pages were at fixed addresses... */
+    unsigned long layout_base; /* ...from this one... */
+    unsigned layout_seed;      /* ...with noise pages drawn from this */
+} runinfo_t;
+
+/* Describes the machine the driver is running on */
+typedef struct {
+    char hostname[256];
+    struct utsname uts;
+    char cpu[1024];      /* CPU model name */
+    long ncpus;          /* online CPUs */
+    long page_size;
+} hostinfo_t;
+
+/* Fill in a description of this machine */
+void get_hostinfo(hostinfo_t *h);
+
+/* Output formats for write_results */
+#define FORMAT_JSON 1
+#define FORMAT_CSV  2
+
+/* Fill in the totals of r from its per-trace stats */
+void results_totals(results_t *r);
+
+/* Write nres sets of results to fp in the given format */
+void write_results(FILE *fp, int format, runinfo_t *info,
+		   results_t *res, int nres);
+
+#endif /* __RESULTS_H_ */
@@ -0,0 +1,415 @@
+/*
+ * trace.c - Reading and writing allocator traces
+ *
+ * A text trace is parsed op by op into a malloc'd array. A binary
+ * trace is mapped read-only and its ops are replayed straight from the
+ * mapping, so loading it costs one pass to check the ops rather than
+ * a parse and a copy. MAP_POPULATE faults the pages in up front, so
+ * that the timed replays don't take page faults on the trace itself.
+ *
+ * A trace stream holds only two windows of ops. A reader thread fills
+ * one window while the caller replays the other, so the replay rarely
+ * waits on the disk and memory use doesn't grow with the trace.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <errno.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "trace.h"
+
+#define MAXLINE 1024
+
+/* report a failed system call and exit */
+static void trace_unix_error(const char *msg, const char *path)
+{
+    printf("%s %s: %s\n", msg, path, strerror(errno));
+    exit(1);
+}
+
+/* report a malformed trace and exit */
+static void trace_error(const char *msg, const char *path)
+{
+    printf("%s in tracefile %s\n", msg, path);
+    exit(1);
+}
+
+/* allocate the blocks and block_sizes arrays of a trace */
+static void alloc_blocks(trace_t *trace)
+{
+    /* We'll keep an array of pointers to the allocated blocks here... */
+    if ((trace->blocks =
+	 (char **)malloc(trace->num_ids * sizeof(char *))) == NULL)
+	trace_unix_error("malloc failed for", "blocks");
+
+    /* ... along with the corresponding byte sizes of each block */
+    if ((trace->block_sizes =
+	 (size_t *)malloc(trace->num_ids * sizeof(size_t))) == NULL)
+	trace_unix_error("malloc failed for", "block sizes");
+}
+
+/* read the header of a text trace */
+static void read_text_header(trace_t *trace, FILE *tracefile)
+{
+    fscanf(tracefile, "%d", &(trace->sugg_heapsize)); /* not used */
+    fscanf(tracefile, "%d", &(trace->num_ids));
+    fscanf(tracefile, "%d", &(trace->num_ops));
+    fscanf(tracefile, "%d", &(trace->weight));        /* not used */
+}
+
+/* read the next request line of a text trace into op; return 0 at EOF */
+static int read_text_op(FILE *tracefile, traceop_t *op, const char *path)
+{
+    char type[MAXLINE];
+    unsigned index = 0, size = 0;
+
+    if (fscanf(tracefile, "%s", type) == EOF)
+	return 0;
+    switch(type[0]) {
+    case 'a':
+	fscanf(tracefile, "%u %u", &index, &size);
+	op->type = ALLOC;
+	break;
+    case 'r':
+	fscanf(tracefile, "%u %u", &index, &size);
+	op->type = REALLOC;
+	break;
+    case 'f':
+	fscanf(tracefile, "%ud", &index);
+	op->type = FREE;
+	break;
+    default:
+	printf("Bogus type character (%c) in tracefile %s\n",
+	       type[0], path);
+	exit(1);
+    }
+    op->index = index;
+    op->size = size;
+    return 1;
+}
+
+/* read a text trace */
+static void read_text(trace_t *trace, FILE *tracefile, const char *path)
+{
+    unsigned max_index = 0;
+    unsigned op_index;
+    traceop_t *op;
+
+    read_text_header(trace, tracefile);
+
+    /* We'll store each request line in the trace in this array */
+    if ((trace->ops =
+	 (traceop_t *)malloc(trace->num_ops * sizeof(traceop_t))) == NULL)
+	trace_unix_error("malloc failed for the ops of", path);
+    alloc_blocks(trace);
+
+    /* read every request line in the trace file */
+    op_index = 0;
+    while (op_index < trace->num_ops) {
+	op = &trace->ops[op_index];
+	if (!read_text_op(tracefile, op, path))
+	    break;
+	if (op->type != FREE && (unsigned)op->index > max_index)
+	    max_index = op->index;
+	op_index++;
+    }
+    assert(max_index == trace->num_ids - 1);
+    assert(trace->num_ops == op_index);
+}
+
+/* check the header of a binary trace against the file size */
+static void check_hdr(trace_hdr_t *hdr, size_t file_size, const char *path)
+{
+    if (hdr->version != TRACE_VERSION || hdr->op_size != sizeof(traceop_t))
+	trace_error("Unsupported version or byte order", path);
+    if (hdr->num_ops < 0 || hdr->num_ids < 0 ||
+	file_size < sizeof(trace_hdr_t)
+	+ (size_t)hdr->num_ops * sizeof(traceop_t))
+	trace_error("Truncated ops", path);
+}
+
+/* exit if a binary op has a bad type or index */
+static void check_op(traceop_t *op, int num_ids, const char *path)
+{
+    if ((unsigned)op->index >= (unsigned)num_ids ||
+	(op->type != ALLOC && op->type != FREE && op->type != REALLOC))
+	trace_error("Bogus op", path);
+}
+
+/* map a binary trace, and check its header and every op */
+static void read_bin(trace_t *trace, int fd, const char *path)
+{
+    struct stat st;
+    trace_hdr_t *hdr;
+    traceop_t *op;
+    int i;
+
+    if (fstat(fd, &st) < 0)
+	trace_unix_error("Could not stat", path);
+    if ((size_t)st.st_size < sizeof(trace_hdr_t))
+	trace_error("Truncated header", path);
+    trace->map_size = st.st_size;
+    trace->map = mmap(NULL, trace->map_size, PROT_READ,
+		      MAP_PRIVATE | MAP_POPULATE, fd, 0);
+    if (trace->map == MAP_FAILED)
+	trace_unix_error("Could not map", path);
+
+    hdr = trace->map;
+    check_hdr(hdr, trace->map_size, path);
+    trace->sugg_heapsize = hdr->sugg_heapsize;
+    trace->num_ids = hdr->num_ids;
+    trace->num_ops = hdr->num_ops;
+    trace->weight = hdr->weight;
+    trace->ops = (traceop_t *)(hdr + 1);
+    alloc_blocks(trace);
+
+    /* the replay trusts every index, so make sure they are in range */
+    for (i = 0, op = trace->ops; i < trace->num_ops; i++, op++)
+	check_op(op, trace->num_ids, path);
+}
+
+/*
+ * read_trace - read a trace file and store it in memory, as text or,
+ *     if it starts with TRACE_MAGIC, in the binary format
+ */
+trace_t *read_trace(const char *tracedir, const char *filename)
+{
+    FILE *tracefile;
+    trace_t *trace;
+    char path[MAXLINE];
+    char magic[sizeof(((trace_hdr_t *)0)->magic)];
+
+    /* Allocate the trace record */
+    if ((trace = (trace_t *) calloc(1, sizeof(trace_t))) == NULL)
+	trace_unix_error("malloc failed for", filename);
+
+    /* Read the trace file header */
+    snprintf(path, sizeof(path), "%s%s", tracedir, filename);
+    if ((tracefile = fopen(path, "r")) == NULL)
+	trace_unix_error("Could not open", path);
+    if (fread(magic, sizeof(magic), 1, tracefile) == 1 &&
+	memcmp(magic, TRACE_MAGIC, sizeof(magic)) == 0)
+	read_bin(trace, fileno(tracefile), path);
+    else {
+	rewind(tracefile);
+	read_text(trace, tracefile, path);
+    }
+    fclose(tracefile);
+
+    return trace;
+}
+
+/*
+ * free_trace - Free the trace record and the three arrays it points
+ *              to, all of which were allocated in read_trace().
+ */
+void free_trace(trace_t *trace)
+{
+    if (trace->map != NULL)
+	munmap(trace->map, trace->map_size);
+    else
+	free(trace->ops);     /* free the three arrays... */
+    free(trace->blocks);
+    free(trace->block_sizes);
+    free(trace);              /* and the trace record itself... */
+}
+
+/*
+ * write_trace_bin - Write out a trace in the binary format
+ */
+int write_trace_bin(const char *path, trace_t *trace)
+{
+    FILE *fp;
+    trace_hdr_t hdr;
+    int ok;
+
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, TRACE_MAGIC, sizeof(hdr.magic));
+    hdr.version = TRACE_VERSION;
+    hdr.op_size = sizeof(traceop_t);
+    hdr.sugg_heapsize = trace->sugg_heapsize;
+    hdr.num_ids = trace->num_ids;
+    hdr.num_ops = trace->num_ops;
+    hdr.weight = trace->weight;
+
+    if ((fp = fopen(path, "w")) == NULL)
+	return -1;
+    ok = fwrite(&hdr, sizeof(hdr), 1, fp) == 1
+	&& fwrite(trace->ops, sizeof(traceop_t), trace->num_ops, fp)
+	== (size_t)trace->num_ops;
+    if (fclose(fp) != 0)
+	ok = 0;
+    return ok ? 0 : -1;
+}
+
+/*****************
+ * Trace streams
+ *****************/
+
+struct trace_stream {
+    FILE *fp;
+    int bin;                  /* set for a binary trace */
+    char path[MAXLINE];
+    trace_t hdr;              /* header fields only */
+    int window;               /* ops per buffer */
+    traceop_t *buf[2];
+    int len[2];               /* ops in each buffer, 0 at the end */
+    int full[2];              /* set while a buffer waits to be replayed */
+    int cur;                  /* buffer the caller gets next */
+    int held;                 /* set while the caller holds a buffer */
+    int stop;                 /* tells the reader to quit */
+    int remaining;            /* ops the reader has yet to read */
+    pthread_t reader;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+};
+
+/* fill one buffer with up to a window of ops, returning how many */
+static int fill(trace_stream_t *s, traceop_t *buf)
+{
+    int i, n = 0;
+
+    if (s->bin) {
+	n = (s->remaining < s->window) ? s->remaining : s->window;
+	if (n > 0 && fread(buf, sizeof(traceop_t), n, s->fp) != (size_t)n)
+	    trace_error("Truncated ops", s->path);
+	for (i = 0; i < n; i++)
+	    check_op(&buf[i], s->hdr.num_ids, s->path);
+    }
+    else {
+	while (n < s->window && n < s->remaining
+	       && read_text_op(s->fp, &buf[n], s->path))
+	    n++;
+    }
+    s->remaining -= n;
+    return n;
+}
+
+/* the reader thread: fill the two buffers in turn until the end */
+static void *reader(void *arg)
+{
+    trace_stream_t *s = arg;
+    int k = 0, n;
+
+    do {
+	pthread_mutex_lock(&s->lock);
+	while (s->full[k] && !s->stop)
+	    pthread_cond_wait(&s->cond, &s->lock);
+	pthread_mutex_unlock(&s->lock);
+	if (s->stop)
+	    break;
+
+	n = fill(s, s->buf[k]);
+
+	pthread_mutex_lock(&s->lock);
+	s->len[k] = n;
+	s->full[k] = 1;
+	pthread_cond_broadcast(&s->cond);
+	pthread_mutex_unlock(&s->lock);
+	k = 1 - k;
+    } while (n > 0);
+    return NULL;
+}
+
+/*
+ * trace_stream_open - Open a text or binary trace for streaming, and
+ *     start reading ahead
+ */
+trace_stream_t *trace_stream_open(const char *tracedir, const char *filename,
+				  int window)
+{
+    trace_stream_t *s;
+    trace_hdr_t hdr;
+    struct stat st;
+    int k;
+
+    if ((s = calloc(1, sizeof(trace_stream_t))) == NULL)
+	trace_unix_error("malloc failed for", filename);
+    snprintf(s->path, sizeof(s->path), "%s%s", tracedir, filename);
+    if ((s->fp = fopen(s->path, "r")) == NULL)
+	trace_unix_error("Could not open", s->path);
+
+    if (fread(&hdr, sizeof(hdr), 1, s->fp) == 1 &&
+	memcmp(hdr.magic, TRACE_MAGIC, sizeof(hdr.magic)) == 0) {
+	if (fstat(fileno(s->fp), &st) < 0)
+	    trace_unix_error("Could not stat", s->path);
+	check_hdr(&hdr, st.st_size, s->path);
+	s->bin = 1;
+	s->hdr.sugg_heapsize = hdr.sugg_heapsize;
+	s->hdr.num_ids = hdr.num_ids;
+	s->hdr.num_ops = hdr.num_ops;
+	s->hdr.weight = hdr.weight;
+    }
+    else {
+	rewind(s->fp);
+	read_text_header(&s->hdr, s->fp);
+    }
+
+    s->window = window;
+    s->remaining = s->hdr.num_ops;
+    for (k = 0; k < 2; k++)
+	if ((s->buf[k] = malloc(window * sizeof(traceop_t))) == NULL)
+	    trace_unix_error("malloc failed for the window of", s->path);
+    pthread_mutex_init(&s->lock, NULL);
+    pthread_cond_init(&s->cond, NULL);
+    if ((errno = pthread_create(&s->reader, NULL, reader, s)) != 0)
+	trace_unix_error("Could not start a reader for", s->path);
+    return s;
+}
+
+/*
+ * trace_stream_next - Release the window returned by the last call,
+ *     and return the next one with its length in *n, or NULL at the end
+ */
+traceop_t *trace_stream_next(trace_stream_t *s, int *n)
+{
+    traceop_t *ops;
+
+    pthread_mutex_lock(&s->lock);
+    if (s->held) {
+	s->full[s->cur] = 0;
+	s->cur = 1 - s->cur;
+	s->held = 0;
+	pthread_cond_broadcast(&s->cond);
+    }
+    while (!s->full[s->cur])
+	pthread_cond_wait(&s->cond, &s->lock);
+    *n = s->len[s->cur];
+    ops = (*n > 0) ? s->buf[s->cur] : NULL;
+    s->held = (*n > 0);
+    pthread_mutex_unlock(&s->lock);
+    return ops;
+}
+
+/*
+ * trace_stream_ops - The number of ops in the stream's trace
+ */
+int trace_stream_ops(trace_stream_t *s)
+{
+    return s->hdr.num_ops;
+}
+
+/*
+ * trace_stream_close - Stop the reader and free the stream
+ */
+void trace_stream_close(trace_stream_t *s)
+{
+    pthread_mutex_lock(&s->lock);
+    s->stop = 1;
+    pthread_cond_broadcast(&s->cond);
+    pthread_mutex_unlock(&s->lock);
+    pthread_join(s->reader, NULL);
+
+    pthread_mutex_destroy(&s->lock);
+    pthread_cond_destroy(&s->cond);
+    fclose(s->fp);
+    free(s->buf[0]);
+    free(s->buf[1]);
+    free(s);
+}
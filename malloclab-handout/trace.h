@@ -0,0 +1,68 @@
+/*
+ * trace.h - Reading and writing allocator traces, in either the text
+ *     (.rep) format or a compact binary format that is mmap'd
+ */
+#ifndef __TRACE_H_
+#define __TRACE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Characterizes a single trace operation (allocator request) */
+typedef struct {
+    enum {ALLOC, FREE, REALLOC} type; /* type of request */
+    int index;                        /* index for free() to use later */
+    int size;                         /* byte size of alloc/realloc request */
+} traceop_t;
+
+/* Holds the information for one trace file*/
+typedef struct {
+    int sugg_heapsize;   /* suggested heap size (unused) */
+    int num_ids;         /* number of alloc/realloc ids */
+    int num_ops;         /* number of distinct requests */
+    int weight;          /* weight for this trace (unused) */
+    traceop_t *ops;      /* array of requests */
+    char **blocks;       /* array of ptrs returned by malloc/realloc... */
+    size_t *block_sizes; /* ... and a corresponding array of payload sizes */
+    void *map;           /* mapping that ops points into, or NULL */
+    size_t map_size;
+} trace_t;
+
+/*
+ * A binary trace is this header, followed by num_ops traceop_t records
+ * exactly as they are laid out in memory, in native byte order.
+ */
+#define TRACE_MAGIC   "MALLOCTR"
+#define TRACE_VERSION 1
+
+typedef struct {
+    char magic[8];       /* TRACE_MAGIC, not NUL-terminated */
+    uint32_t version;    /* TRACE_VERSION */
+    uint32_t op_size;    /* sizeof(traceop_t) of the writer */
+    int32_t sugg_heapsize;
+    int32_t num_ids;
+    int32_t num_ops;
+    int32_t weight;
+} trace_hdr_t;
+
+/* Read a text or binary trace, exiting with a message on any error */
+trace_t *read_trace(const char *tracedir, const char *filename);
+void free_trace(trace_t *trace);
+
+/* Write a trace in the binary format. Return 0, or -1 on error */
+int write_trace_bin(const char *path, trace_t *trace);
+
+/*
+ * A trace stream delivers the ops of a trace a window at a time, read
+ * ahead by another thread, so that traces larger than memory can be
+ * replayed. The caller tracks the live blocks itself.
+ */
+typedef struct trace_stream trace_stream_t;
+
+trace_stream_t *trace_stream_open(const char *tracedir, const char *filename,
+				  int window);
+traceop_t *trace_stream_next(trace_stream_t *s, int *n);
+int trace_stream_ops(trace_stream_t *s);
+void trace_stream_close(trace_stream_t *s);
+
+#endif /* __TRACE_H_ */